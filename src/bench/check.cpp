@@ -0,0 +1,225 @@
+/*cxe{
+    -std=c++20
+    -O2
+    -if (--target=[darwin]) {
+        -pre { mkdir -p ../../bin/macos }
+        -o ../../bin/macos/bench_check
+        -lstdc++
+    }
+    -if (--target=[linux]) {
+        -pre { mkdir -p ../../bin/linux }
+        -o ../../bin/linux/bench_check
+        -lstdc++
+    }
+    -if (--target=[windows]) {
+        -pre { mkdir -p ../../bin/windows }
+        -o ../../bin/windows/bench_check.exe
+        -D_CRT_SECURE_NO_WARNINGS
+    }
+}*/
+
+// Checks the persistent records of cxe against their own readers: the
+// .cxedeps log of deps::record() and deps::up_to_date(), the manifests and
+// artifacts of the compile cache, the fingerprint and drift of a profile,
+// and the compaction of the probe store.  Works in [directory], which is
+// created if need be, and exits with the number of failed checks.
+//
+//     cxe src/bench/check.cpp -- [directory]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include "../cxe/cache.hpp"
+#include "../cxe/deps.hpp"
+#include "../cxe/environment.hpp"
+#include "../cxe/pgo.hpp"
+#include "../cxe/probe.hpp"
+
+using namespace cxe;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    println(ok ? "ok      " : "FAILED  ", what);
+    if (not ok) failures += 1;
+}
+
+bool write(const char* path, const char* text) {
+    return file::save(path, text, strlen(text));
+}
+
+// set the modification time of path to seconds ago
+bool backdate(const char* path, int seconds) {
+    const time_t t = time(nullptr) - seconds;
+    #if defined(_WIN32)
+        struct _utimbuf times { t, t };
+        return 0 == _utime(path, &times);
+    #else
+        struct utimbuf times { t, t };
+        return 0 == utime(path, &times);
+    #endif
+}
+
+//------------------------------------------------------------------------------
+
+void check_deps() {
+    write("in.c", "#include \"in.h\"\n");
+    write("in.h", "int x;\n");
+    write("in.d", "out.o: in.c in.h\n");
+    write("out.o", "object\n");
+    backdate("in.c", 10);
+    backdate("in.h", 10);
+    backdate("out.o", 5);
+
+    command cmd;
+    cmd.kind(command::compile);
+    for (const char* arg : { "cc", "-c", "in.c", "-o", "out.o", "-MMD", "-MF", "in.d" })
+        cmd.append(token_t(arg, strlen(arg)));
+    cmd.output("out.o");
+
+    check(deps::record(cmd), "deps: record");
+    check(deps::up_to_date(cmd), "deps: up to date after record");
+
+    path::touch("in.h");
+    check(not deps::up_to_date(cmd), "deps: changed input invalidates");
+
+    backdate("in.h", 10);
+    check(deps::up_to_date(cmd), "deps: up to date once the input is older again");
+
+    cmd.append(token_t("-O2", 3));
+    check(not deps::up_to_date(cmd), "deps: changed arguments invalidate");
+
+    check(deps::record(cmd), "deps: record the new arguments");
+    check(deps::up_to_date(cmd), "deps: up to date with the new arguments");
+}
+
+void check_cache() {
+    path::make_dirs(cache::path_to("/m").data());
+    path::make_dirs(cache::path_to("/r").data());
+    write("in.c", "int y;\n");
+
+    cxe::hash h;
+    const uint64_t base = h.update("cxe/check").digest();
+    const uint64_t key = 0x1234;
+
+    buffer<cache::input> inputs;
+    check(inputs.emplace_back().scan("in.c"), "cache: scan input");
+    {
+        cache::manifest m(base);
+        m.insert(key, std::move(inputs));
+        check(m.save(), "cache: save manifest");
+    }
+    {
+        cache::manifest m(base);
+        uint64_t found = 0;
+        const buffer<cache::input>* const in = m.lookup(found);
+        check(in and found == key, "cache: manifest round trip");
+        check(in and in->size() == 1 and 0 == strcmp(in->front().path.data(), "in.c"),
+            "cache: manifest inputs round trip");
+    }
+
+    write("in.c", "int y, z;\n");
+    {
+        cache::manifest m(base);
+        uint64_t found = 0;
+        check(not m.lookup(found), "cache: changed input misses");
+    }
+
+    write("out.o", "artifact\n");
+    cache::store(key, "out.o", buffer<char>());
+    path::remove("out.o");
+    buffer<char> text;
+    check(cache::restore(key, "out.o") and file::load("out.o", text)
+        and 0 == strcmp(text.data(), "artifact\n"), "cache: artifact round trip");
+}
+
+pgo::source make_source(const char* path, uint64_t hash, uint64_t size) {
+    pgo::source s;
+    s.path << path;
+    s.hash = hash;
+    s.size = size;
+    return s;
+}
+
+void check_pgo() {
+    buffer<pgo::source> old;
+    old.emplace_back(make_source("a.c", 1, 100));
+    old.emplace_back(make_source("b.c", 2, 100));
+
+    pgo::save("sources", old);
+    const buffer<pgo::source> loaded = pgo::load("sources");
+    check(loaded.size() == 2 and loaded[1].hash == 2 and loaded[1].size == 100
+        and 0 == strcmp(loaded[1].path.data(), "b.c"), "pgo: fingerprint round trip");
+
+    check(pgo::drift(old, old) == 0, "pgo: no drift");
+
+    buffer<pgo::source> changed;
+    changed.emplace_back(make_source("a.c", 3, 100));
+    changed.emplace_back(make_source("b.c", 2, 100));
+    check(pgo::drift(old, changed) == 50, "pgo: changed source drifts");
+
+    buffer<pgo::source> added;
+    added.emplace_back(make_source("a.c", 1, 100));
+    added.emplace_back(make_source("b.c", 2, 100));
+    added.emplace_back(make_source("c.c", 4, 50));
+    check(pgo::drift(old, added) == 20, "pgo: added source drifts");
+
+    buffer<pgo::source> removed;
+    removed.emplace_back(make_source("a.c", 1, 100));
+    check(pgo::drift(old, removed) == 100, "pgo: removed source drifts");
+
+    check(pgo::drift(old, buffer<pgo::source>()) == 100, "pgo: no sources left");
+}
+
+// must run before any other probe, which would load the store
+void check_probe() {
+    char hex[17];
+    buffer<char> text;
+    for (uint64_t k = 1; k <= 20000; ++k)
+        println_to(text, hash::format(hex, 0x1000000000000000 + k), " stale");
+    for (int i = 0; i < 10; ++i)
+        println_to(text, hash::format(hex, 0x2000000000000001), " old ", i);
+    println_to(text, hash::format(hex, 0x2000000000000002), " live");
+    file::save(probe::store_path().data(), text.data(), text.size());
+
+    buffer<char> first; first << "first";
+    probe::store(0x2000000000000003, first);
+    text.clear();
+    file::load(probe::store_path().data(), text);
+    check(text.size() and text.size() < 256 * 1024, "probe: store compacted");
+
+    buffer<char> value;
+    check(probe::lookup(0x2000000000000002, value)
+        and 0 == strcmp(value.data(), "live"), "probe: live entry kept");
+    value.clear();
+    check(probe::lookup(0x2000000000000001, value)
+        and 0 == strcmp(value.data(), "old 9"), "probe: newest duplicate kept");
+
+    buffer<char> second; second << "second";
+    probe::store(0x2000000000000004, second);
+    text.clear();
+    file::load(probe::store_path().data(), text);
+    check(scan::contains(" first\n", text) and scan::contains(" second\n", text),
+        "probe: later stores append to the compacted store");
+}
+
+int main(int argc, const char* argv[]) {
+    const char* const dir = argc > 1 ? argv[1] : "cxe-check";
+    if (not path::make_dirs(dir) or not path::set(dir)) {
+        println("check: cannot enter ", dir);
+        return 1;
+    }
+
+    buffer<char> cache_dir; cache_dir << "cache";
+    path::make_dirs(cache_dir.data());
+    path::qualify(cache_dir);
+    new environment::variable("CXE_CACHE_DIR", cache_dir.data());
+
+    check_probe();
+    check_deps();
+    check_cache();
+    check_pgo();
+    return failures;
+}
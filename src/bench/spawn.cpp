@@ -0,0 +1,97 @@
+/*cxe{
+    -std=c++20
+    -O2
+    -if (--target=[darwin]) {
+        -pre { mkdir -p ../../bin/macos }
+        -o ../../bin/macos/bench_spawn
+        -lstdc++
+    }
+    -if (--target=[linux]) {
+        -pre { mkdir -p ../../bin/linux }
+        -o ../../bin/linux/bench_spawn
+        -lstdc++
+    }
+    -if (--target=[windows]) {
+        -pre { mkdir -p ../../bin/windows }
+        -o ../../bin/windows/bench_spawn.exe
+        -D_CRT_SECURE_NO_WARNINGS
+    }
+}*/
+
+// Compares the latency of running a trivial command with system(), with
+// fork() + execvp(), and with cxe::shell::run_argv() (posix_spawnp).  An
+// optional resident set of <megabytes> is touched first, to show how the
+// cost of fork() grows with the size of the parent process.
+//
+//     cxe src/bench/spawn.cpp -- [iterations] [megabytes]
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include "../cxe/shell.hpp"
+
+using namespace cxe;
+using clock_type = std::chrono::steady_clock;
+
+template<typename Fn>
+double measure(const char* name, int iterations, Fn&& fn) {
+    const auto start = clock_type::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (fn()) {
+            println(name, ": failed");
+            return 0;
+        }
+    }
+    const auto stop = clock_type::now();
+    const double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    const double per_call = us / iterations;
+    printf("%-20s %12.3f us/call\n", name, per_call);
+    return per_call;
+}
+
+int main(int argc, const char* argv[]) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    const size_t megabytes = argc > 2 ? size_t(atoi(argv[2])) : 0;
+
+    // touch every page, so that the memory is resident
+    char* const rss = megabytes ? (char*)malloc(megabytes << 20) : nullptr;
+    if (rss) memset(rss, 1, megabytes << 20);
+
+    #if defined(_WIN32)
+        char* cmd_argv[] = { (char*)"cmd", (char*)"/c", (char*)"rem", nullptr };
+        const char* const cmd_line = "rem";
+    #else
+        char* cmd_argv[] = { (char*)"true", nullptr };
+        const char* const cmd_line = "true";
+    #endif
+
+    println("running \"", cmd_line, "\" ", iterations, " times",
+        " with ", megabytes, "MB resident");
+
+    const double system_us = measure("system()", iterations, [&]() {
+        return system(cmd_line);
+    });
+
+    #if not defined(_WIN32)
+    measure("fork()+execvp()", iterations, [&]() {
+        const pid_t pid = fork();
+        if (pid == 0) { execvp(cmd_argv[0], cmd_argv); _exit(127); }
+        if (pid < 0) return -1;
+        return shell::_posix::wait(cmd_argv[0], pid);
+    });
+    #endif
+
+    const double spawn_us = measure("shell::run_argv", iterations, [&]() {
+        return shell::run_argv(cmd_argv);
+    });
+
+    if (spawn_us > 0) {
+        printf("speedup over system(): %5.1fx\n", system_us / spawn_us);
+    }
+
+    free(rss);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*cxe{
+    -std=c++20
+    -O2
+    -if (--target=[darwin]) {
+        -pre { mkdir -p ../../bin/macos }
+        -o ../../bin/macos/bench_which
+        -lstdc++
+    }
+    -if (--target=[linux]) {
+        -pre { mkdir -p ../../bin/linux }
+        -o ../../bin/linux/bench_which
+        -lstdc++
+    }
+    -if (--target=[windows]) {
+        -pre { mkdir -p ../../bin/windows }
+        -o ../../bin/windows/bench_which.exe
+        -D_CRT_SECURE_NO_WARNINGS
+    }
+}*/
+
+// Compares the latency of resolving a command through PATH by running
+// `which`/`where` through the shell, against cxe::shell::_which() (native)
+// and cxe::shell::which() (native + memoized).
+//
+//     cxe src/bench/which.cpp -- [command] [iterations]
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include "../cxe/shell.hpp"
+
+using namespace cxe;
+using clock_type = std::chrono::steady_clock;
+
+template<typename Fn>
+double measure(const char* name, int iterations, Fn&& fn) {
+    buffer<char> out;
+    const auto start = clock_type::now();
+    for (int i = 0; i < iterations; ++i) {
+        out.clear();
+        if (fn(out)) {
+            println(name, ": failed");
+            return 0;
+        }
+    }
+    const auto stop = clock_type::now();
+    const double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    const double per_call = us / iterations;
+    printf("%-20s %12.3f us/call  -> %s\n", name, per_call, out.data());
+    return per_call;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* const cmd = argc > 1 ? argv[1] : "cc";
+    const int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+    #if defined(_WIN32)
+        const char* const which_cmd = "where ";
+    #else
+        const char* const which_cmd = "which ";
+    #endif
+
+    println("resolving \"", cmd, "\" ", iterations, " times");
+
+    const double shell_us = measure("shell which", iterations, [&](auto& out) {
+        return shell::run(out, which_cmd, cmd);
+    });
+
+    const double native_us = measure("shell::_which", iterations, [&](auto& out) {
+        return shell::_which(out, cmd);
+    });
+
+    const double memo_us = measure("shell::which", iterations, [&](auto& out) {
+        return shell::which(out, cmd);
+    });
+
+    if (native_us > 0 and memo_us > 0) {
+        printf("native speedup:   %10.1fx\n", shell_us / native_us);
+        printf("memoized speedup: %10.1fx\n", shell_us / memo_us);
+    }
+    return 0;
+}
@@ -21,6 +21,7 @@ function usage {
     echo "  -v              Enable verbose output."
     echo "  -x <ext>        Specify source language, e.g.: -x c, -x c++"
     echo "  --clean         Delete build artifacts."
+    echo "  --linux "..."   Specify linux-specific flags"
     echo "  --macos "..."   Specify macOS-specific flags"
     echo "  --windows "..." Specify windows-specific flags"
     echo "  --            Run the compiled app, passing along remaining arguments."
@@ -44,6 +45,7 @@ function realpath {
 
 LIB_NAMES=()
 C_CPP_SOURCES=()
+LINUX_FLAGS=()
 MACOS_FLAGS=()
 WINDOWS_FLAGS=()
 while [ $# -gt 0 ]; do
@@ -66,6 +68,11 @@ while [ $# -gt 0 ]; do
             shift
             shift
         ;;
+        --linux)
+            LINUX_FLAGS+=($2)
+            shift
+            shift
+        ;;
         --macos)
             MACOS_FLAGS+=($2)
             shift
@@ -184,8 +191,18 @@ case $(uname | tr '[:upper:]' '[:lower:]') in
     ;;
     linux*)
         BUILD_OS=linux
-        echo "unsupported operating system"
-        exit 1
+        CMD_DIR="$ROOT_BIN_DIR/linux"
+        CMD_BIN="$CMD_DIR/$BIN_NAME"
+        CMD_DEP="$CMD_DIR/$BIN_NAME.dep"
+        LIB_DIR="$ROOT_LIB_DIR/linux"
+        LIB_EXT=".a"
+        LIB_BIN="$LIB_DIR/$BIN_NAME$LIB_EXT"
+        LIB_DEP="$LIB_DIR/$BIN_NAME.dep"
+
+        # GNU ld resolves libraries in order, so these follow the sources
+        for LINUX_FLAG in "${LINUX_FLAGS[@]}"; do
+            LDFLAGS="${LDFLAGS} $LINUX_FLAG"
+        done
     ;;
     msys*|mingw*)
         BUILD_OS=windows
@@ -236,6 +253,8 @@ for LIB_NAME in "${LIB_NAMES[@]}"; do
     CFLAGS="$CFLAGS $LIB_DIR/$LIB_NAME$LIB_EXT"
 done
 
+CFLAGS="$CFLAGS$LDFLAGS"
+
 #-------------------------------------------------------------------------------
 
 if [ $COMPILE_LIB ]; then
@@ -5,6 +5,7 @@
     -fsanitize=address \
     -std=c++20 "$0" \
     --windows "-D_DISABLE_VECTOR_ANNOTATION" \
+    --linux "-lstdc++" \
     --macos "-lstdc++" \
     "$@"; \
 exit $?
@@ -16,17 +17,24 @@ exit $?
 #include <sys/types.h>
 #include <new>
 #include "cxe/buffer.hpp"
+#include "cxe/cache.hpp"
 #include "cxe/command.hpp"
 #include "cxe/context.hpp"
+#include "cxe/deps.hpp"
 #include "cxe/environment.hpp"
 #include "cxe/file.hpp"
+#include "cxe/jobserver.hpp"
+#include "cxe/linker.hpp"
 #include "cxe/parser.hpp"
 #include "cxe/path.hpp"
 #include "cxe/print.hpp"
+#include "cxe/probe.hpp"
 #include "cxe/scan.hpp"
+#include "cxe/schedule.hpp"
 #include "cxe/scope.hpp"
 #include "cxe/shell.hpp"
 #include "cxe/token.hpp"
+#include "cxe/tune.hpp"
 #include "cxe/usage.hpp"
 
 using namespace cxe;
@@ -58,13 +66,22 @@ bool streq(const Span& a, const Span& b) {
     return 0 == strncmp(a.data(), b.data(), size);
 }
 
-bool has_arg(const char* const arg, const int argc, const char* argv[]) {
-    for (int i = 1; i < argc; ++i) {
+// whether arg is among the options of cxe, before any --
+bool has_option(const char* const arg, const int argc, const char* argv[]) {
+    for (int i = 1; i < argc and not streq(argv[i], "--"); ++i) {
         if (streq(argv[i], arg)) return true;
     }
     return false;
 }
 
+// the argument following the option arg, before any --, or null
+const char* arg_value(const char* const arg, const int argc, const char* argv[]) {
+    for (int i = 1; i + 1 < argc and not streq(argv[i], "--"); ++i) {
+        if (streq(argv[i], arg)) return argv[i + 1];
+    }
+    return nullptr;
+}
+
 //------------------------------------------------------------------------------
 
 std::span<const char> span(const char* const str) {
@@ -109,10 +126,16 @@ int main(const int argc, const char* argv[], const char* envp[]) {
 
     for (int i = 0; i < argc; ++i) {
         auto arg = span(argv[i]);
+        // the arguments after -- belong to the program
+        if (cxe::scan::equals("--", arg)) break;
         if (cxe::scan::equals("--help", arg)) {
             puts(USAGE);
             return 1;
         }
+        if (cxe::scan::equals("--cache-stats", arg)) {
+            cache::report();
+            return 0;
+        }
     }
 
     using namespace escape_codes;
@@ -159,6 +182,8 @@ int main(const int argc, const char* argv[], const char* envp[]) {
         token_t name = src_path;
         while (seek("/", name) and skip("/", name));
         chop(".cpp", name, ignore_case) or
+        chop(".cppm", name, ignore_case) or
+        chop(".ixx", name, ignore_case) or
         chop(".cxx", name, ignore_case) or
         chop(".c++", name, ignore_case) or
         chop(".cc",  name, ignore_case) or
@@ -197,48 +222,27 @@ int main(const int argc, const char* argv[], const char* envp[]) {
         error(1,loc,"expected C/C++ source file: ", src_path);
     }
 
-    const buffer<char> src_buffer = [&]() -> auto {
-        cxe::file f { src_path.data(), "r" };
-        if (not f) {
-            printf("file not found: %s\n", src_path.data());
-            exit(1);
-        }
-
-        buffer<char> buf;
-
-        const size_t start = f.tell();
-
-        if (not f.seek(CXE_COMMENT_HEAD))
-            return buf;
-
-        if (not f.seek_and_skip(CXE_COMMENT_TAIL))
-            return buf;
-
-        const size_t size = f.tell() - start;
-        buf.resize(size);
-
-        f.set(start);
-        f.read(buf.data(), size);
-        return buf;
-    }();
-
     const buffer<char> compiler_buffer = [&]() -> auto {
         using namespace ::cxe::scan;
         buffer<char> buf;
-        if (is_cpp_path(src_path)) {
+        if (const char* const compiler = arg_value("--tune-compiler", argc, argv)) {
+            // a variant of --tune, see tune.hpp
+            buf << compiler;
+        }
+        else if (is_cpp_path(src_path)) {
             // detect C++ compiler
             if (const char* const CXX = getenv("CXX"))    { buf << CXX; }
             else if (const char* const CC = getenv("CC")) { buf << CC;  }
-            else if (0 == shell::which(buf, "clang"))     {}
-            else if (0 == shell::which(buf, "gcc"))       {}
-            else if (0 == shell::which(buf, "c++"))       {}
+            else if (0 == probe::which(buf, "clang"))     {}
+            else if (0 == probe::which(buf, "gcc"))       {}
+            else if (0 == probe::which(buf, "c++"))       {}
         }
         else if (is_c_path(src_path)) {
             // detect C compiler
             if (const char* const CC = getenv("CC"))  { buf << CC; }
-            else if (0 == shell::which(buf, "clang")) {}
-            else if (0 == shell::which(buf, "gcc"))   {}
-            else if (0 == shell::which(buf, "cc"))    {}
+            else if (0 == probe::which(buf, "clang")) {}
+            else if (0 == probe::which(buf, "gcc"))   {}
+            else if (0 == probe::which(buf, "cc"))    {}
         }
         else {
             location loc = {};
@@ -260,6 +264,34 @@ int main(const int argc, const char* argv[], const char* envp[]) {
         return buf;
     }();
 
+    // probe the default target while we read the source
+    probe::speculate(span(compiler_buffer));
+
+    const buffer<char> src_buffer = [&]() -> auto {
+        cxe::file f { src_path.data(), "r" };
+        if (not f) {
+            printf("file not found: %s\n", src_path.data());
+            exit(1);
+        }
+
+        buffer<char> buf;
+
+        const size_t start = f.tell();
+
+        if (not f.seek(CXE_COMMENT_HEAD))
+            return buf;
+
+        if (not f.seek_and_skip(CXE_COMMENT_TAIL))
+            return buf;
+
+        const size_t size = f.tell() - start;
+        buf.resize(size);
+
+        f.set(start);
+        f.read(buf.data(), size);
+        return buf;
+    }();
+
     const context ctx {
         cxe_path,
         cxe_name,
@@ -278,28 +310,24 @@ int main(const int argc, const char* argv[], const char* envp[]) {
     path::set(src_dir_buffer.data());
 
     scope s = __func__;
-    auto cmds = parser::parse(ctx);
-    for (auto& cmd : cmds) {
-        buffer<char> cmdline;
-        for (const char* arg : cmd) {
-            if (cmdline.size())
-                cmdline << " ";
-            cmdline << arg;
-        }
+    size_t jobs = 0;
 
-        if (not scan::prefix(ctx.cxe_path, cmdline))
-            println(cmdline.data());
+    if (has_option("--tune", argc, argv)) {
+        tune::plan plan = parser::plan(ctx, jobs);
+        jobserver::client js { jobs ? jobs : schedule::default_jobs() };
+        return tune::run(ctx, plan, jobs, js);
+    }
 
-        fflush(stdout);
+    auto cmds = parser::parse(ctx, jobs);
 
-        // change directory before executing command
-        // if cmd.dir() is non-empty
-        if (const char* cmd_dir = cmd.dir(); cmd_dir[0])
-            path::set(cmd_dir);
+    // share one job budget with nested cxe, make and ninja processes
+    jobserver::client js { jobs ? jobs : schedule::default_jobs() };
 
-        const int status = shell::run_argv(cmd.argv());
-        if (status) { exit(status); }
-    }
+    const int status = schedule::run(ctx, cmds, jobs, js);
+    if (status or not has_option("--link-bench", argc, argv)) return status;
 
-    return 0;
+    for (command& cmd : cmds) {
+        if (linker::links(cmd)) return linker::bench(ctx, cmd);
+    }
+    error(1,{},"--link-bench: the build does not link");
 }
\ No newline at end of file
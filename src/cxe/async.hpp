@@ -0,0 +1,682 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <coroutine>
+#include <utility>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "print.hpp"
+#include "shell.hpp"
+
+#if defined(__linux__)
+    #include <sys/epoll.h>
+    #include <sys/syscall.h>
+#elif not defined(_WIN32)
+    #include <poll.h>
+#endif
+
+#if defined(_WIN32)
+    #include <thread>
+#endif
+
+// Asynchronous processes, driven by a single event loop and awaited from
+// C++20 coroutines:
+//
+//     async::task build(async::loop& loop, command& cmd) {
+//         co_return co_await loop.spawn(cmd.argv(), { .echo = "..." });
+//     }
+//
+// The stdout and stderr of each process go to a pipe each, which the loop
+// drains into per-process buffers.  Those are written to stdout and stderr
+// in one piece when the process exits, so the output of concurrent
+// processes never interleaves.  On Linux the loop waits on the pipes and on
+// a pidfd per process with epoll; elsewhere on POSIX it uses poll() and
+// reaps with waitpid(WNOHANG).  On Windows, processes run to completion one
+// at a time.  Tasks may also wait for a file descriptor, or for a time.
+
+namespace cxe::async {
+
+    // a lazily started coroutine which produces an exit status
+    class task {
+    public:
+
+        struct promise_type;
+
+        using handle_t = std::coroutine_handle<promise_type>;
+
+        struct promise_type {
+            int status = -1;
+            std::coroutine_handle<> continuation;
+
+            task get_return_object() {
+                return task(handle_t::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            // resume whoever awaited this task, if anyone
+            struct final_awaiter {
+                bool await_ready() noexcept { return false; }
+
+                std::coroutine_handle<> await_suspend(handle_t h) noexcept {
+                    const auto c = h.promise().continuation;
+                    return c ? c : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            final_awaiter final_suspend() noexcept { return {}; }
+
+            void return_value(int s) { status = s; }
+
+            void unhandled_exception() { fatal("unhandled exception in task"); }
+        };
+
+    private:
+
+        handle_t _handle;
+
+        explicit task(handle_t h) : _handle(h) {}
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+    public:
+
+        task() = default;
+
+        task(task&& src) : _handle(std::exchange(src._handle, {})) {}
+
+        task& operator=(task&& src) {
+            if (this != &src) {
+                if (_handle) _handle.destroy();
+                _handle = std::exchange(src._handle, {});
+            }
+            return *this;
+        }
+
+        ~task() { if (_handle) _handle.destroy(); }
+
+        handle_t handle() const { return _handle; }
+
+        bool done() const { return not _handle or _handle.done(); }
+
+        int status() const { verify(_handle.done()); return _handle.promise().status; }
+
+        // awaiting a task starts it, and resumes the awaiter once it is done
+        bool await_ready() const { return _handle.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+            _handle.promise().continuation = h;
+            return _handle;
+        }
+
+        int await_resume() const { return _handle.promise().status; }
+    };
+
+    //--------------------------------------------------------------------------
+
+    struct options {
+        const char* dir     = nullptr; // working directory of the process
+        const char* echo    = nullptr; // line printed ahead of the output
+        bool        capture = true;    // buffer output until the process exits
+        buffer<char>* log   = nullptr; // receives a copy of the captured stderr
+        bool        print   = true;    // write the captured output on exit
+    };
+
+    // Write the output of a process, as the loop does once it exits: out,
+    // the echo and stdout of the process, to stdout, then errors to stderr.
+    void write_output(const buffer<char>& out, const buffer<char>& errors) {
+        if (out.size()) {
+            fflush(stdout);
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+        }
+        if (errors.size()) {
+            fflush(stderr);
+            fwrite(errors.data(), 1, errors.size(), stderr);
+            fflush(stderr);
+        }
+    }
+
+    class loop {
+        struct process {
+            buffer<char>            name;
+            buffer<char>            output; // the echo, then stdout
+            buffer<char>            errors; // stderr
+            buffer<char>*           log = nullptr;
+            bool                    print = true;
+            std::coroutine_handle<> waiter;
+            int                     status = -1;
+            bool                    exited = false;
+            #if not defined(_WIN32)
+                pid_t               pid    = -1;
+                int                 pipe   = -1; // of stdout
+                int                 errors_pipe = -1;
+                int                 pidfd  = -1;
+            #endif
+        };
+
+        // a coroutine waiting for a file descriptor to become readable
+        struct watch {
+            int                     fd;
+            std::coroutine_handle<> waiter;
+        };
+
+        // a coroutine waiting for a time to pass
+        struct timer {
+            std::chrono::steady_clock::time_point at;
+            std::coroutine_handle<>               waiter;
+        };
+
+        buffer<process*>                _running;
+        buffer<watch>                   _watches;
+        buffer<timer>                   _timers;
+        buffer<std::coroutine_handle<>> _ready;
+        buffer<task>                    _tasks;
+
+        #if defined(__linux__)
+            int _epoll = -1;
+
+            int epoll() {
+                if (_epoll < 0) _epoll = epoll_create1(EPOLL_CLOEXEC);
+                return _epoll;
+            }
+        #endif
+
+        static constexpr size_t CHUNK = 64 * 1024;
+
+        loop(const loop&) = delete;
+        loop& operator=(const loop&) = delete;
+
+        //----------------------------------------------------------------------
+
+        #if not defined(_WIN32)
+
+        void close_pipe(int& fd) {
+            if (fd < 0) return;
+            #if defined(__linux__)
+                epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+            #endif
+            close(fd);
+            fd = -1;
+        }
+
+        // read whatever is available from fd into out, closing it at eof
+        void drain(int& fd, buffer<char>& out) {
+            while (fd >= 0) {
+                const size_t size = out.size();
+                out.resize(size + CHUNK);
+                const ssize_t n = ::read(fd, out.data() + size, CHUNK);
+                out.resize(size + (n > 0 ? size_t(n) : 0));
+                if (n > 0) continue;
+                if (n < 0 and errno == EINTR) continue;
+                if (n < 0 and errno == EAGAIN) return;
+                close_pipe(fd);
+            }
+        }
+
+        void drain(process& p) {
+            drain(p.pipe, p.output);
+            drain(p.errors_pipe, p.errors);
+        }
+
+        // collect p's exit status if it has exited, without blocking
+        void reap(process& p) {
+            int st = 0;
+            pid_t r;
+            do { r = waitpid(p.pid, &st, WNOHANG); }
+            while (r < 0 and errno == EINTR);
+            if (r == 0) return;
+
+            p.status = r < 0 ? -1 : shell::_posix::decode_status(p.name.data(), st);
+            p.exited = true;
+
+            // output written before the exit is still in the pipes; anything
+            // written later by grandchildren holding the pipes is dropped
+            drain(p);
+            close_pipe(p.pipe);
+            close_pipe(p.errors_pipe);
+
+            #if defined(__linux__)
+                if (p.pidfd >= 0) { close(p.pidfd); p.pidfd = -1; }
+            #endif
+        }
+
+        #endif
+
+        process* start_process(char* argv[], const options& opt) {
+            process* const p = new process;
+            p->name << argv[0];
+            p->log = opt.log;
+            p->print = opt.print;
+
+            // on Windows, processes run one at a time and cannot interleave
+            #if defined(_WIN32)
+                const bool capture = false;
+            #else
+                const bool capture = opt.capture;
+            #endif
+
+            if (opt.echo) {
+                if (capture) {
+                    println_to(p->output, opt.echo);
+                } else {
+                    println(opt.echo);
+                }
+            }
+
+            #if defined(_WIN32)
+
+                using namespace ::cxe::shell::_win32;
+
+                fflush(stdout);
+
+                STARTUPINFOA si {
+                    .cb         = sizeof(si),
+                    .dwFlags    = STARTF_USESTDHANDLES,
+                    .hStdInput  = GetStdHandle(STD_INPUT_HANDLE),
+                    .hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE),
+                    .hStdError  = GetStdHandle(STD_ERROR_HANDLE),
+                };
+
+                PROCESS_INFORMATION pi;
+
+                buffer<char> buf;
+                for (auto argp = argv; *argp; ++argp) {
+                    if (buf.size())
+                        buf << " ";
+                    buf << *argp;
+                }
+
+                const int created = CreateProcessA(
+                    nullptr,    // lpApplicationName
+                    buf.data(), // lpCommandLine
+                    nullptr,    // lpProcessAttributes
+                    nullptr,    // lpThreadAttributes
+                    true,       // bInheritHandles
+                    0,          // dwCreationFlags
+                    nullptr,    // lpEnvironment
+                    opt.dir,    // lpCurrentDirectory
+                    &si,        // lpStartupInfo
+                    &pi         // lpProcessInformation
+                );
+
+                if (created) {
+                    CloseHandle(pi.hThread);
+                    WaitForSingleObject(pi.hProcess, INFINITE);
+                    if (not GetExitCodeProcess(pi.hProcess, &p->status))
+                        p->status = -1;
+                    CloseHandle(pi.hProcess);
+                }
+                p->exited = true;
+                return p;
+
+            #else
+
+                // out[] for stdout, err[] for stderr; without them, fail as
+                // a spawn fails, with status -1
+                int out[2] = { -1, -1 };
+                int err[2] = { -1, -1 };
+                if (capture) {
+                    for (int* fds : { out, err }) {
+                        #if defined(__linux__)
+                            const bool made = 0 == pipe2(fds, O_CLOEXEC);
+                        #else
+                            const bool made = 0 == pipe(fds);
+                            if (made) {
+                                fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+                                fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+                            }
+                        #endif
+                        if (not made) {
+                            for (const int fd : { out[0], out[1] }) if (fd >= 0) close(fd);
+                            p->exited = true;
+                            return p;
+                        }
+                        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+                    }
+                }
+
+                posix_spawn_file_actions_t actions;
+                posix_spawn_file_actions_init(&actions);
+                if (capture) {
+                    posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+                    posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+                }
+
+                // change directory in the child; where the platform cannot,
+                // let the shell do it: sh -c 'cd "$0" && exec "$@"' dir argv...
+                buffer<char*> sh_argv;
+                if (opt.dir and opt.dir[0]) {
+                    #if defined(__APPLE__) or (defined(__GLIBC__) and \
+                        (__GLIBC__ > 2 or __GLIBC_MINOR__ >= 29))
+                        posix_spawn_file_actions_addchdir_np(&actions, opt.dir);
+                    #else
+                        sh_argv.push_back(const_cast<char*>("/bin/sh"));
+                        sh_argv.push_back(const_cast<char*>("-c"));
+                        sh_argv.push_back(const_cast<char*>("cd \"$0\" && exec \"$@\""));
+                        sh_argv.push_back(const_cast<char*>(opt.dir));
+                        for (auto argp = argv; *argp; ++argp) sh_argv.push_back(*argp);
+                        sh_argv.push_back(nullptr);
+                        argv = sh_argv.data();
+                    #endif
+                }
+
+                // keep our own buffered output ahead of the child's
+                fflush(stdout);
+                fflush(stderr);
+
+                p->pid = shell::_posix::spawn(argv, &actions);
+                posix_spawn_file_actions_destroy(&actions);
+                if (capture) { close(out[1]); close(err[1]); }
+
+                if (p->pid < 0) {
+                    if (capture) { close(out[0]); close(err[0]); }
+                    p->exited = true;
+                    return p;
+                }
+
+                p->pipe = out[0];
+                p->errors_pipe = err[0];
+
+                #if defined(__linux__)
+                    // a pidfd becomes readable when the process exits;
+                    // kernels before 5.3 fall back to polling waitpid()
+                    p->pidfd = int(syscall(SYS_pidfd_open, p->pid, 0));
+
+                    for (const int fd : { p->pipe, p->errors_pipe, p->pidfd }) {
+                        if (fd < 0) continue;
+                        epoll_event ev {};
+                        ev.events = EPOLLIN;
+                        ev.data.fd = fd;
+                        epoll_ctl(epoll(), EPOLL_CTL_ADD, fd, &ev);
+                    }
+                #endif
+
+                return p;
+
+            #endif
+        }
+
+        void add_watch(int fd, std::coroutine_handle<> h) {
+            #if defined(_WIN32)
+                (void)fd;
+                _ready.push_back(h); // not supported, resume immediately
+            #else
+                bool watched = false;
+                for (const watch& w : _watches) watched |= w.fd == fd;
+                _watches.push_back({ fd, h });
+                #if defined(__linux__)
+                    if (watched) return;
+                    epoll_event ev {};
+                    ev.events = EPOLLIN;
+                    ev.data.fd = fd;
+                    epoll_ctl(epoll(), EPOLL_CTL_ADD, fd, &ev);
+                #endif
+            #endif
+        }
+
+        // resume every coroutine waiting for fd
+        void wake(int fd) {
+            bool woke = false;
+            for (size_t i = 0; i < _watches.size();) {
+                if (_watches[i].fd != fd) { ++i; continue; }
+                _ready.push_back(_watches[i].waiter);
+                _watches[i] = _watches.back();
+                _watches.pop_back();
+                woke = true;
+            }
+            #if defined(__linux__)
+                if (woke) epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+            #else
+                (void)woke;
+            #endif
+        }
+
+        // milliseconds until the first timer is due, or else timeout
+        int until_timer(int timeout) const {
+            using namespace std::chrono;
+            const auto now = steady_clock::now();
+            for (const timer& t : _timers) {
+                const auto due = ceil<milliseconds>(t.at - now).count();
+                const int ms = due < 0 ? 0 : int(due);
+                if (timeout < 0 or ms < timeout) timeout = ms;
+            }
+            return timeout;
+        }
+
+        // resume every coroutine whose timer is due
+        void expire_timers() {
+            const auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < _timers.size();) {
+                if (_timers[i].at > now) { ++i; continue; }
+                _ready.push_back(_timers[i].waiter);
+                _timers[i] = _timers.back();
+                _timers.pop_back();
+            }
+        }
+
+        // wait for at least one event, and handle every event that arrived
+        void poll() {
+            for (process* p : _running) {
+                if (p->exited) return complete();
+            }
+
+            #if not defined(_WIN32)
+
+                #if defined(__linux__)
+
+                    // processes without a pidfd must be polled for exit
+                    int timeout = -1;
+                    for (process* p : _running) {
+                        if (not p->exited and p->pidfd < 0) timeout = 10;
+                    }
+                    timeout = until_timer(timeout);
+
+                    epoll_event events[32];
+                    const int n = epoll_wait(epoll(), events, 32, timeout);
+                    for (int i = 0; i < n; ++i) {
+                        const int fd = events[i].data.fd;
+                        bool handled = false;
+                        for (process* p : _running) {
+                            if (p->pipe == fd or p->errors_pipe == fd) {
+                                drain(*p);
+                                handled = true;
+                                break;
+                            }
+                            if (p->pidfd == fd) { reap(*p);  handled = true; break; }
+                        }
+                        if (not handled) wake(fd);
+                    }
+
+                    for (process* p : _running) {
+                        if (not p->exited and p->pidfd < 0) reap(*p);
+                    }
+
+                #else
+
+                    // a process closes its end of the pipes as it exits,
+                    // so waiting on pipes alone is usually enough
+                    buffer<pollfd> fds;
+                    int timeout = 50;
+                    for (process* p : _running) {
+                        if (p->exited) continue;
+                        if (p->pipe < 0 and p->errors_pipe < 0) timeout = 1;
+                        for (const int fd : { p->pipe, p->errors_pipe }) {
+                            if (fd >= 0) fds.push_back({ fd, POLLIN, 0 });
+                        }
+                    }
+                    timeout = until_timer(timeout);
+                    const size_t first_watch = fds.size();
+                    for (const watch& w : _watches) {
+                        fds.push_back({ w.fd, POLLIN, 0 });
+                    }
+
+                    ::poll(fds.data(), nfds_t(fds.size()), timeout);
+
+                    for (size_t i = first_watch; i < fds.size(); ++i) {
+                        if (fds[i].revents) wake(fds[i].fd);
+                    }
+
+                    for (process* p : _running) {
+                        if (p->exited) continue;
+                        drain(*p);
+                        reap(*p);
+                    }
+
+                #endif
+
+            #else
+
+                // processes ran to completion as they were spawned
+                if (_timers.size()) {
+                    const int timeout = until_timer(-1);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+                }
+
+            #endif
+
+            expire_timers();
+            complete();
+        }
+
+        // flush the output of exited processes, and resume their waiters
+        void complete() {
+            for (size_t i = 0; i < _running.size();) {
+                process* const p = _running[i];
+                if (not p->exited) { ++i; continue; }
+
+                _running[i] = _running.back();
+                _running.pop_back();
+
+                if (p->log) p->log->insert(p->log->end(), p->errors.begin(), p->errors.end());
+
+                if (p->print) write_output(p->output, p->errors);
+
+                _ready.push_back(p->waiter);
+            }
+        }
+
+    public:
+
+        loop() = default;
+
+        ~loop() {
+            #if defined(__linux__)
+                if (_epoll >= 0) close(_epoll);
+            #endif
+        }
+
+        // number of processes which have been spawned and not yet reaped
+        size_t running() const { return _running.size(); }
+
+        // the awaitable returned by spawn(), resumes with the exit status
+        class spawn_op {
+            loop&          _loop;
+            char**         _argv;
+            const options  _opt;
+            process*       _process = nullptr;
+
+        public:
+
+            spawn_op(loop& l, char** argv, const options& opt)
+                : _loop(l), _argv(argv), _opt(opt) {}
+
+            bool await_ready() const { return false; }
+
+            // a process which failed to start exits at once, with status -1
+            void await_suspend(std::coroutine_handle<> h) {
+                _process = _loop.start_process(_argv, _opt);
+                verify(_process);
+                _process->waiter = h;
+                _loop._running.push_back(_process);
+            }
+
+            int await_resume() {
+                const int status = _process->status;
+                delete _process;
+                _process = nullptr;
+                return status;
+            }
+        };
+
+        // the awaitable returned by sleep()
+        class sleep_op {
+            loop&                                 _loop;
+            std::chrono::steady_clock::time_point _at;
+
+        public:
+
+            sleep_op(loop& l, int ms)
+                : _loop(l), _at(std::chrono::steady_clock::now() + std::chrono::milliseconds(ms)) {}
+
+            bool await_ready() const { return false; }
+
+            void await_suspend(std::coroutine_handle<> h) { _loop._timers.push_back({ _at, h }); }
+
+            void await_resume() const {}
+        };
+
+        // the awaitable returned by readable()
+        class readable_op {
+            loop& _loop;
+            int   _fd;
+
+        public:
+
+            readable_op(loop& l, int fd) : _loop(l), _fd(fd) {}
+
+            bool await_ready() const { return false; }
+
+            void await_suspend(std::coroutine_handle<> h) { _loop.add_watch(_fd, h); }
+
+            void await_resume() const {}
+        };
+
+        // awaiting the result resumes once fd is readable, or has hung up
+        readable_op readable(int fd) { return readable_op(*this, fd); }
+
+        // awaiting the result resumes once ms milliseconds have passed, while
+        // other tasks run
+        sleep_op sleep(int ms) { return sleep_op(*this, ms); }
+
+        // spawn argv[0], searching PATH; awaiting the result yields its
+        // exit status once it has exited and its output has been flushed
+        spawn_op spawn(char* argv[], const options& opt = {}) {
+            return spawn_op(*this, argv, opt);
+        }
+
+        // run t concurrently with the other tasks of this loop
+        void start(task&& t) {
+            _ready.push_back(t.handle());
+            _tasks.push_back(std::move(t));
+        }
+
+        // run until every task has finished
+        void run() {
+            for (;;) {
+                while (_ready.size()) {
+                    const buffer<std::coroutine_handle<>> ready = std::move(_ready);
+                    _ready = {};
+                    for (const std::coroutine_handle<> h : ready) h.resume();
+                }
+                if (_running.empty() and _watches.empty() and _timers.empty()) break;
+                poll();
+            }
+            verify(_running.empty());
+        }
+
+        // run t, and every other task, to completion; returns t's status
+        int run(task&& t) {
+            const task::handle_t h = t.handle();
+            start(std::move(t));
+            run();
+            return h.promise().status;
+        }
+    };
+
+} // namespace cxe::async
@@ -257,6 +257,12 @@ namespace cxe {
             verify(null_terminated());
         }
 
+        void insert(size_t i, T* p) {
+            verify(i <= size());
+            base::insert(base::begin() + i, p);
+            verify(null_terminated());
+        }
+
         void pop_back() {
             verify(null_terminated());
             base::pop_back();
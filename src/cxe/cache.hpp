@@ -0,0 +1,568 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "verify.hpp"
+#include "async.hpp"
+#include "buffer.hpp"
+#include "cc1.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "depfile.hpp"
+#include "deps.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "lock.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "record.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// Content-addressed artifact cache for the compile command.
+//
+// Layout of the cache directory:
+//
+//     m/<base>       manifest: known dependency sets for a command line
+//     r/<key>.out    cached artifact
+//     r/<key>.log    captured compiler diagnostics, the stderr of the compile
+//     stats          hit/miss counters
+//     stats.lock     held while updating them
+//
+// <base> hashes the compiler identity, working directory and resolved argv.
+// Each manifest entry lists the inputs observed when the artifact was built
+// (from the depfile and from file arguments such as libraries), together with
+// their content hashes.  <key> hashes <base> and those content hashes, so a
+// lookup only needs to stat (and rarely rehash) the recorded inputs.
+
+namespace cxe::cache {
+
+    // CXE_CACHE=0 disables the cache
+    bool enabled() {
+        const char* const value = getenv("CXE_CACHE");
+        return not (value and 0 == strcmp(value, "0"));
+    }
+
+    // CXE_CACHE_DIR overrides the default per-user cache directory
+    const char* dir() {
+        static const buffer<char> buf = []() -> auto {
+            buffer<char> buf;
+            if (const char* const d = getenv("CXE_CACHE_DIR"); d and d[0]) {
+                buf << d;
+            } else {
+                #if defined(_WIN32)
+                    if (const char* const d = getenv("LOCALAPPDATA"))
+                        buf << d << "/cxe";
+                #elif defined(__APPLE__)
+                    if (const char* const d = getenv("HOME"))
+                        buf << d << "/Library/Caches/cxe";
+                #else
+                    if (const char* const d = getenv("XDG_CACHE_HOME"); d and d[0])
+                        buf << d << "/cxe";
+                    else if (const char* const d = getenv("HOME"))
+                        buf << d << "/.cache/cxe";
+                #endif
+            }
+            if (buf.empty()) buf << ".cxe-cache";
+            path::normalize(buf);
+            return buf;
+        }();
+        return buf.data();
+    }
+
+    // size given as e.g. "512M" or "2G", or size if value is null or empty
+    uint64_t parse_size(const char* value, uint64_t size) {
+        if (not value) return size;
+        char* end = nullptr;
+        uint64_t n = strtoull(value, &end, 10);
+        switch (end ? *end : 0) {
+            case 'k': case 'K': n <<= 10; break;
+            case 'm': case 'M': n <<= 20; break;
+            case 'g': case 'G': n <<= 30; break;
+        }
+        return end != value ? n : size;
+    }
+
+    // CXE_CACHE_SIZE limits the cache size, e.g. "512M" or "2G"
+    uint64_t max_size() {
+        return parse_size(getenv("CXE_CACHE_SIZE"), uint64_t(1) << 30);
+    }
+
+    template<typename... Args>
+    buffer<char> path_to(const Args&... args) {
+        buffer<char> buf;
+        print_to(buf, dir(), args...);
+        return buf;
+    }
+
+    //--------------------------------------------------------------------------
+
+    struct stats {
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t evictions = 0;
+
+        static stats load() {
+            stats s;
+            buffer<char> text;
+            if (not file::load(path_to("/stats").data(), text)) return s;
+            using namespace ::cxe::scan;
+            itr_t itr = text.data();
+            end_t end = itr + text.size();
+            while (itr < end) {
+                itr_t key = itr;
+                if (not seek(' ', itr, end)) break;
+                const token_t name { key, itr };
+                const uint64_t value = strtoull(itr, nullptr, 10);
+                if (equals("hits",      name)) s.hits      = value;
+                if (equals("misses",    name)) s.misses    = value;
+                if (equals("evictions", name)) s.evictions = value;
+                if (not seek('\n', itr, end)) break;
+                skip('\n', itr, end);
+            }
+            return s;
+        }
+
+        void save() const {
+            buffer<char> text;
+            println_to(text, "hits ",      hits);
+            println_to(text, "misses ",    misses);
+            println_to(text, "evictions ", evictions);
+            file::save(path_to("/stats").data(), text.data(), text.size());
+        }
+
+        // concurrent compiles and cxe processes count under the lock
+        template<typename Field>
+        static void count(Field field, uint64_t n = 1) {
+            const lock l { path_to("/stats.lock").data() };
+            stats s = load();
+            s.*field += n;
+            s.save();
+        }
+    };
+
+    //--------------------------------------------------------------------------
+
+    struct item {
+        buffer<char> path;
+        uint64_t     size  = 0;
+        int64_t      mtime = 0;
+    };
+
+    void collect(buffer<item>& items, const char* subdir) {
+        const buffer<char> dir_path = path_to(subdir);
+        path::each(dir_path.data(), [&](const char* name) {
+            item i;
+            print_to(i.path, dir_path, "/", name);
+            const path::info info = path::stat(i.path.data());
+            if (not info or info.dir) return;
+            i.size  = info.size;
+            i.mtime = info.mtime;
+            items.emplace_back(std::move(i));
+        });
+    }
+
+    uint64_t size() {
+        buffer<item> items;
+        collect(items, "/m");
+        collect(items, "/r");
+        uint64_t total = 0;
+        for (const item& i : items) total += i.size;
+        return total;
+    }
+
+    // remove least recently used files until the cache fits in max_size()
+    void evict() {
+        buffer<item> items;
+        collect(items, "/m");
+        collect(items, "/r");
+
+        uint64_t total = 0;
+        for (const item& i : items) total += i.size;
+
+        const uint64_t limit = max_size();
+        if (total <= limit) return;
+
+        std::sort(items.begin(), items.end(), [](const item& a, const item& b) {
+            return a.mtime < b.mtime;
+        });
+
+        // evict down to 90% so that we don't evict on every store
+        const uint64_t target = limit - limit / 10;
+        uint64_t evicted = 0;
+        for (const item& i : items) {
+            if (total <= target) break;
+            if (path::remove(i.path.data())) {
+                total -= i.size;
+                evicted += 1;
+            }
+        }
+        stats::count(&stats::evictions, evicted);
+    }
+
+    //--------------------------------------------------------------------------
+
+    void print_size(uint64_t bytes) {
+        if (bytes >= (uint64_t(1) << 30)) print(bytes >> 30, " GiB");
+        else
+        if (bytes >= (uint64_t(1) << 20)) print(bytes >> 20, " MiB");
+        else
+        if (bytes >= (uint64_t(1) << 10)) print(bytes >> 10, " KiB");
+        else
+        print(bytes, " B");
+    }
+
+    // print cache location, size and hit/miss counters (--cache-stats)
+    void report() {
+        const stats s = stats::load();
+        const uint64_t lookups = s.hits + s.misses;
+        println("cache directory: ", dir());
+        print  ("cache size:      "); print_size(size());
+        print  (" / "); print_size(max_size()); println();
+        println("hits:            ", s.hits);
+        println("misses:          ", s.misses);
+        println("evictions:       ", s.evictions);
+        if (lookups) {
+            println("hit rate:        ", (s.hits * 100) / lookups, "%");
+        }
+        if (not enabled()) {
+            println("cache disabled by CXE_CACHE=0");
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    struct input {
+        buffer<char> path;
+        uint64_t     size  = 0;
+        int64_t      mtime = 0;
+        uint64_t     hash  = 0;
+
+        // stat the file, and hash its contents
+        bool scan(const char* p) {
+            path.clear(); path << p;
+            const path::info info = path::stat(p);
+            if (not info or info.dir) return false;
+            size  = info.size;
+            mtime = info.mtime;
+            cxe::hash h;
+            if (not h.update_file(p)) return false;
+            hash = h.digest();
+            return true;
+        }
+
+        // true if the file still has the recorded contents;
+        // contents are only rehashed if size or mtime changed
+        bool unchanged() const {
+            const path::info info = path::stat(path.data());
+            if (not info or info.dir) return false;
+            if (info.size != size) return false;
+            if (info.mtime == mtime) return true;
+            cxe::hash h;
+            return h.update_file(path.data()) and h.digest() == hash;
+        }
+    };
+
+    class manifest {
+        static constexpr uint32_t MAGIC   = 0x4D455843; // "CXEM"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t MAX_ENTRIES = 8;
+
+        struct entry {
+            uint64_t      key = 0;
+            buffer<input> inputs;
+        };
+
+        buffer<char>  _path;
+        buffer<entry> _entries;
+
+    public:
+
+        manifest(uint64_t base) {
+            char name[17];
+            _path = path_to("/m/", hash::format(name, base));
+
+            buffer<char> data;
+            if (not file::load(_path.data(), data)) return;
+
+            record::reader r(data);
+            if (r.read<uint32_t>() != MAGIC)   return;
+            if (r.read<uint32_t>() != VERSION) return;
+            const uint32_t n = r.read<uint32_t>();
+            for (uint32_t i = 0; r and i < n; ++i) {
+                entry e;
+                e.key = r.read<uint64_t>();
+                const uint32_t m = r.read<uint32_t>();
+                for (uint32_t j = 0; r and j < m; ++j) {
+                    input in;
+                    r.read_string(in.path);
+                    in.size  = r.read<uint64_t>();
+                    in.mtime = r.read<int64_t>();
+                    in.hash  = r.read<uint64_t>();
+                    e.inputs.emplace_back(std::move(in));
+                }
+                if (r) _entries.emplace_back(std::move(e));
+            }
+        }
+
+        const char* path() const { return _path.data(); }
+
+        // find an entry whose inputs are all unchanged
+        const buffer<input>* lookup(uint64_t& key) const {
+            for (const entry& e : _entries) {
+                bool match = true;
+                for (const input& in : e.inputs) {
+                    if (not in.unchanged()) { match = false; break; }
+                }
+                if (match) return key = e.key, &e.inputs;
+            }
+            return nullptr;
+        }
+
+        void insert(uint64_t key, buffer<input>&& inputs) {
+            entry e { key, std::move(inputs) };
+            _entries.insert(_entries.begin(), std::move(e));
+            while (_entries.size() > MAX_ENTRIES) _entries.pop_back();
+        }
+
+        bool save() const {
+            buffer<char> data;
+            record::writer w(data);
+            w.write(MAGIC);
+            w.write(VERSION);
+            w.write(uint32_t(_entries.size()));
+            for (const entry& e : _entries) {
+                w.write(e.key);
+                w.write(uint32_t(e.inputs.size()));
+                for (const input& in : e.inputs) {
+                    w.write_string(in.path.data(), in.path.size());
+                    w.write(in.size);
+                    w.write(in.mtime);
+                    w.write(in.hash);
+                }
+            }
+            return file::save(_path.data(), data.data(), data.size());
+        }
+    };
+
+    //--------------------------------------------------------------------------
+
+    // arguments that make a compile uncacheable, because the compiler
+    // produces more than one artifact, or emits something other than an
+    // artifact (e.g. preprocessor dependency output on stdout)
+    bool cacheable(const context& ctx, command& cmd) {
+        using namespace ::cxe::scan;
+        if (not enabled()) return false;
+        if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc)) return false;
+
+        const char* const output = cmd.output();
+        if (not output[0] or 0 == strcmp(output, "-")) return false;
+
+        bool has_depfile = false;
+        for (const char* arg : cmd) {
+            const token_t t { arg, strlen(arg) };
+            if (equals("-MD", t) or equals("-MMD", t)) {
+                has_depfile = true;
+                continue;
+            }
+            if (equals("-MF", t) or equals("-MT", t) or equals("-MQ", t))
+                continue;
+            if (prefix("-M", t)) return false;
+            if (equals("-gsplit-dwarf", t)) return false;
+            // module interfaces are written beside the object, see modules.hpp
+            if (equals("-fmodules-ts", t)) return false;
+            if (prefix("-fmodule-output", t)) return false;
+            if (prefix("-fprebuilt-module-path", t)) return false;
+            if (prefix("-save-temps", t)) return false;
+            if (equals("--coverage", t)) return false;
+            if (equals("-ftest-coverage", t)) return false;
+        }
+        if (has_depfile and not cmd.find(equals, token_t("-MF", 3)))
+            return false;
+        return true;
+    }
+
+    // compiler path, size and modification time
+    void hash_compiler(cxe::hash& h, const context& ctx) {
+        buffer<char> compiler; compiler << ctx.compiler_path;
+        h.update(compiler.data());
+        if (not scan::contains("/", compiler)) {
+            buffer<char> found;
+            if (0 == shell::which(found, compiler.data()))
+                compiler = std::move(found);
+        }
+        const path::info info = path::stat(compiler.data());
+        h.update(info.size);
+        h.update(info.mtime);
+    }
+
+    // compiler identity, working directory, relevant environment and argv
+    uint64_t base_key(const context& ctx, command& cmd) {
+        cxe::hash h;
+        h.update("cxe/cache/1");
+        hash_compiler(h, ctx);
+
+        char cwd[4096] = {0};
+        if (getcwd(cwd, sizeof(cwd))) h.update(cwd);
+
+        static const char* const vars[] = {
+            "CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH", "LIBRARY_PATH",
+            "SDKROOT", "MACOSX_DEPLOYMENT_TARGET",
+        };
+        for (const char* var : vars) {
+            const char* const value = getenv(var);
+            h.update(var);
+            h.update(value ? value : "");
+        }
+
+        for (const char* arg : cmd) h.update(arg);
+        return h.digest();
+    }
+
+    //--------------------------------------------------------------------------
+
+    // print the echo and the diagnostics of a hit as the loop prints those
+    // of a miss, see async::write_output()
+    void replay(const char* echo, const buffer<char>& log) {
+        buffer<char> out;
+        if (echo) println_to(out, echo);
+        async::write_output(out, log);
+    }
+
+    // write inputs as a Makefile rule, the way -MD would
+    void write_depfile(
+        const buffer<char>& dep_path,
+        const char* output,
+        const buffer<input>& inputs
+    ) {
+        buffer<char> text;
+        text << output << ":";
+        for (const input& in : inputs) {
+            text << " \\\n ";
+            for (const char c : in.path) {
+                if (c == ' ' or c == '#') text << '\\';
+                if (c == '$') text << '$';
+                text << c;
+            }
+        }
+        text << "\n";
+        file::save(dep_path.data(), text.data(), text.size());
+    }
+
+    bool restore(uint64_t key, const char* output, const char* echo = nullptr) {
+        char name[17]; hash::format(name, key);
+        const buffer<char> out_path = path_to("/r/", name, ".out");
+        const buffer<char> log_path = path_to("/r/", name, ".log");
+
+        buffer<char> log;
+        if (not file::load(log_path.data(), log)) return false;
+        if (not file::copy(out_path.data(), output)) return false;
+
+        path::touch(out_path.data());
+        path::touch(log_path.data());
+        replay(echo, log);
+        return true;
+    }
+
+    void store(uint64_t key, const char* output, const buffer<char>& log) {
+        char name[17]; hash::format(name, key);
+        const buffer<char> out_path = path_to("/r/", name, ".out");
+        const buffer<char> log_path = path_to("/r/", name, ".log");
+        if (not file::copy(output, out_path.data())) return;
+        file::save(log_path.data(), log.data(), log.size());
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Run the compile command on loop, restoring its artifact from the cache
+    // on a hit and storing it on a miss.  Yields the exit status of the
+    // compiler.  If not null, echo is printed ahead of the diagnostics.
+    async::task run(
+        const context& ctx,
+        command& cmd,
+        async::loop& loop,
+        const char* echo = nullptr
+    ) {
+        if (not cacheable(ctx, cmd))
+            co_return co_await cc1::run(ctx, cmd, loop, { .echo = echo }, path_to("/cc1"));
+
+        path::make_dirs(path_to("/m").data());
+        path::make_dirs(path_to("/r").data());
+        path::make_dirs(path_to("/tmp").data());
+
+        const uint64_t base = base_key(ctx, cmd);
+        manifest m(base);
+
+        // use the command's own depfile, or request a temporary one
+        buffer<char> dep_path = deps::depfile_path(cmd);
+
+        uint64_t key = 0;
+        if (auto* inputs = m.lookup(key); inputs) {
+            if (restore(key, cmd.output(), echo)) {
+                path::touch(m.path());
+                stats::count(&stats::hits);
+                // restore the depfile too, so deps::record() sees the same
+                // inputs it would have seen after running the compiler
+                if (dep_path.size()) write_depfile(dep_path, cmd.output(), *inputs);
+                co_return 0;
+            }
+        }
+
+        stats::count(&stats::misses);
+
+        // the temporary depfile is requested by a copy of the arguments, so
+        // that cmd, and the signature deps::record() takes of it, is unchanged
+        const bool temp_depfile = dep_path.empty();
+        buffer<char*> temp_argv;
+        if (temp_depfile) {
+            // unique among the compiles of this and concurrent processes
+            static unsigned count = 0;
+            const unsigned long long pid = getpid();
+            print_to(dep_path, dir(), "/tmp/", pid, "-", ++count, ".d");
+            for (char* arg : cmd) temp_argv.push_back(arg);
+            temp_argv.push_back(const_cast<char*>("-MD"));
+            temp_argv.push_back(const_cast<char*>("-MF"));
+            temp_argv.push_back(dep_path.data());
+        }
+
+        // the loop prints the diagnostics, and keeps a copy in log; an argv
+        // with a temporary depfile is never seen again, see cc1.hpp
+        buffer<char> log;
+        const async::options opt { .echo = echo, .log = &log };
+        const int status = temp_depfile
+            ? co_await loop.spawn(temp_argv.data(), opt)
+            : co_await cc1::run(ctx, cmd, loop, opt, path_to("/cc1"));
+
+        buffer<char> deps;
+        const bool has_deps = file::load(dep_path.data(), deps);
+        if (temp_depfile) path::remove(dep_path.data());
+        if (status or not has_deps) co_return status;
+
+        // gather inputs, hash their contents and derive the artifact key
+        buffer<buffer<char>> paths;
+        deps::collect_file_args(paths, cmd);
+        depfile::parse(deps, [&](const buffer<char>& p) {
+            for (const buffer<char>& q : paths)
+                if (0 == strcmp(p.data(), q.data())) return;
+            paths.emplace_back() << p;
+        });
+
+        cxe::hash h;
+        h.update(base);
+        buffer<input> inputs;
+        for (const buffer<char>& p : paths) {
+            input& in = inputs.emplace_back();
+            if (not in.scan(p.data())) co_return status; // input vanished
+            h.update(in.path.data());
+            h.update(in.hash);
+        }
+        key = h.digest();
+
+        store(key, cmd.output(), log);
+        m.insert(key, std::move(inputs));
+        m.save();
+        evict();
+        co_return status;
+    }
+
+} // namespace cxe::cache
@@ -0,0 +1,153 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verify.hpp"
+#include "async.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "path.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// Direct invocation of the jobs of the clang driver.
+//
+// Each compile or link by clang runs the driver, which detects the
+// toolchain and then runs the compiler proper, clang -cc1, or the linker.
+// Instead, the first time cxe runs a resolved argv, it asks the driver for
+// its jobs with -###, and if there is exactly one, as for a compile with -c
+// or a link of objects, keeps that job's command line in the cache
+// directory, as cc1/<key>, one argument per line.  Later runs spawn that
+// job directly.  An argv which expands to several jobs, or none, keeps an
+// empty file, and runs the driver as before.
+//
+// <key> hashes the compiler's path, size, modification time and inode, the
+// working directory, the environment the driver reads, and the argv, so an
+// update of the compiler, or a change of the command, expands it again.
+// CXE_CC1=0 always runs the driver.
+
+namespace cxe::cc1 {
+
+    // CXE_CC1=0 disables direct invocation
+    bool enabled(const context& ctx) {
+        if (not ctx.compiler_is_clang) return false;
+        const char* const value = getenv("CXE_CC1");
+        return not (value and 0 == strcmp(value, "0"));
+    }
+
+    uint64_t key(command& cmd) {
+        cxe::hash h;
+        h.update("cxe/cc1/1");
+
+        const char* const compiler = cmd.argv()[0];
+        buffer<char> compiler_path;
+        if (scan::contains("/", token_t(compiler, strlen(compiler)))) compiler_path << compiler;
+        else if (shell::which(compiler_path, compiler)) compiler_path << compiler;
+        const path::info info = path::stat(compiler_path.data());
+        h.update(compiler_path.data());
+        h.update(info.size);
+        h.update(info.mtime);
+        h.update(info.inode);
+
+        char cwd[4096] = {0};
+        if (getcwd(cwd, sizeof(cwd))) h.update(cwd);
+
+        static const char* const vars[] = {
+            "PATH", "CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH",
+            "OBJC_INCLUDE_PATH", "LIBRARY_PATH", "SDKROOT",
+            "MACOSX_DEPLOYMENT_TARGET", "COMPILER_PATH",
+        };
+        for (const char* var : vars) {
+            const char* const value = getenv(var);
+            h.update(var);
+            h.update(value ? value : "");
+        }
+
+        for (const char* arg : cmd) h.update(arg);
+        return h.digest();
+    }
+
+    // Parse the jobs printed by -###, each a line of arguments in double
+    // quotes, e.g.  "/usr/bin/clang-18" "-cc1" "-triple" "x86_64-...", into
+    // one argument per line.  Returns the number of jobs.
+    size_t parse(const buffer<char>& text, buffer<char>& job) {
+        size_t jobs = 0;
+        const char* itr = text.data();
+        const char* const end = itr + text.size();
+        while (itr < end) {
+            const char* eol = (const char*)memchr(itr, '\n', size_t(end - itr));
+            if (not eol) eol = end;
+            if (eol - itr > 2 and itr[0] == ' ' and itr[1] == '"') {
+                ++jobs;
+                job.clear();
+                for (const char* c = itr + 1; c < eol; ++c) {
+                    if (*c != '"') continue;
+                    // an argument, with \ escaping the next character
+                    for (++c; c < eol and *c != '"'; ++c) {
+                        if (*c == '\\' and c + 1 < eol) ++c;
+                        job.push_back(*c);
+                    }
+                    job.push_back('\n');
+                }
+            }
+            itr = eol + 1;
+        }
+        return jobs;
+    }
+
+    // Set job to the job of cmd, one argument per line, from store, or else
+    // from the driver, kept in store.  Empty if cmd must run the driver.
+    async::task expand(
+        command& cmd,
+        async::loop& loop,
+        const char* dir,
+        const buffer<char>& store,
+        buffer<char>& job
+    ) {
+        char hex[17]; hash::format(hex, key(cmd));
+        buffer<char> path; path << store.data() << "/" << hex;
+        if (file::load(path.data(), job)) co_return 0;
+        if (not path::make_dirs(store.data())) co_return 1;
+
+        // -### prints the jobs on stderr, kept in text rather than printed
+        buffer<char*> argv;
+        for (char* arg : cmd) argv.push_back(arg);
+        argv.push_back(const_cast<char*>("-###"));
+        buffer<char> text;
+        const async::options opt { .dir = dir, .log = &text, .print = false };
+        if (const int status = co_await loop.spawn(argv.data(), opt)) co_return status;
+
+        if (1 != parse(text, job)) job.clear();
+        file::save(path.data(), job.data(), job.size());
+        co_return 0;
+    }
+
+    // Run cmd, as the job of the clang driver if it has one, see above.
+    async::task run(
+        const context& ctx,
+        command& cmd,
+        async::loop& loop,
+        async::options opt,
+        buffer<char> store
+    ) {
+        if (not enabled(ctx)) co_return co_await loop.spawn(cmd.argv(), opt);
+
+        buffer<char> job;
+        if (co_await expand(cmd, loop, opt.dir, store, job) or job.empty())
+            co_return co_await loop.spawn(cmd.argv(), opt);
+
+        buffer<char*> argv;
+        for (char* arg = job.data(); arg < job.data() + job.size();) {
+            char* const eol = strchr(arg, '\n');
+            verify(eol);
+            *eol = 0;
+            argv.push_back(arg);
+            arg = eol + 1;
+        }
+        co_return co_await loop.spawn(argv.data(), opt);
+    }
+
+} // namespace cxe::cc1
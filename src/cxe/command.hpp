@@ -20,8 +20,26 @@ namespace cxe {
 
         using this_t = command;
 
+    public:
+
+        enum kind_t : uint8_t {
+            pre_compile, variant, profile, pch, compile, link, optimize, post_compile, execute
+        };
+
+    private:
+
+        kind_t _kind = pre_compile;
+
+        buffer<char> _name;
+
+        buffer<buffer<char>> _after;
+
+        buffer<buffer<char>> _inputs;
+
         buffer<char> _dir;
 
+        buffer<char> _output;
+
         buffer<char*> _argv;
 
         static char* argalloc(const char* src, const size_t len) {
@@ -40,7 +58,12 @@ namespace cxe {
         command() = default;
 
         command(this_t&& src)
-        : _dir(std::move(src._dir))
+        : _kind(src._kind)
+        , _name(std::move(src._name))
+        , _after(std::move(src._after))
+        , _inputs(std::move(src._inputs))
+        , _dir(std::move(src._dir))
+        , _output(std::move(src._output))
         , _argv(std::move(src._argv)) { reset(src); }
 
         this_t& operator=(this_t&& src) { return move(this, src); }
@@ -53,13 +76,43 @@ namespace cxe {
 
         auto end() { return _argv.end(); }
 
+        kind_t kind() const { return _kind; }
+
+        void kind(kind_t kind) { _kind = kind; }
+
+        // name by which other commands may order themselves after this one
+        const char* name() const { return _name.data(); }
+
+        template<typename Src>
+        void name(const Src& src) { _name.clear(); _name << src; }
+
+        // names of the commands which must finish before this one starts
+        const buffer<buffer<char>>& after() const { return _after; }
+
+        template<typename Src>
+        void after(const Src& src) { _after.emplace_back() << src; }
+
+        // files read by this command but not named by its arguments
+        const buffer<buffer<char>>& inputs() const { return _inputs; }
+
+        template<typename Src>
+        void input(const Src& src) { _inputs.emplace_back() << src; }
+
         const char* dir() { return _dir.data(); }
 
         template<typename Src>
         void dir(const Src& src) { verify(_dir.empty()); _dir << src; }
 
+        // path of the artifact produced by this command, if known
+        const char* output() const { return _output.data(); }
+
+        template<typename Src>
+        void output(const Src& src) { _output.clear(); _output << src; }
+
         char** argv() { return _argv.data(); }
 
+        size_t argc() const { return _argv.size(); }
+
         template<typename Src>
         const char* append(const Src& src) {
             char* const arg = argalloc(src.data(), src.size());
@@ -67,6 +120,24 @@ namespace cxe {
             return arg;
         }
 
+        // insert an argument before the argument at index i
+        template<typename Src>
+        const char* insert(size_t i, const Src& src) {
+            verify(0 < i and i <= _argv.size());
+            char* const arg = argalloc(src.data(), src.size());
+            _argv.insert(i, arg);
+            return arg;
+        }
+
+        // replace the argument at index i
+        template<typename Src>
+        const char* replace(size_t i, const Src& src) {
+            verify(i < _argv.size());
+            free(_argv[i]);
+            _argv[i] = argalloc(src.data(), src.size());
+            return _argv[i];
+        }
+
         using match_t = bool(*)(const token_t& a, const token_t& b);
 
         const char* find(match_t match, const token_t& expect) const {
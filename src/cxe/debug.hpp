@@ -0,0 +1,114 @@
+#pragma once
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+
+// Debug build profile.
+//
+// With -debug, the build gets -g, so that "-if (-g)" conditionals hold,
+// and, with clang or gcc on Linux, the options which keep the link of a
+// large debug build short:
+//
+//   - -gsplit-dwarf: the DWARF of each object goes to a .dwo file beside
+//     it, and the link only copies the small skeleton left in the object.
+//     The build always links objects from the object store (see
+//     parser::store_dir()), even of a single source, so the .dwo files live
+//     there, and those of sources no longer in the build are removed.
+//   - -gz: the debug sections of objects and program are compressed.
+//   - -ggnu-pubnames, and -Wl,--gdb-index when linking with gold, lld or
+//     mold: the debugger loads a prebuilt index rather than scanning the
+//     DWARF of the whole program on startup.
+//
+// With -dwp, the .dwo files are also packed into <output>.dwp after the
+// link, with dwp for gcc or llvm-dwp for clang, for debugging the program
+// away from its object store.  As the dwp of binutils only packs DWARF 4,
+// gcc then compiles with -gdwarf-4, unless the build sets a version.
+
+namespace cxe::debug {
+
+    // whether the profile's options apply with the compiler of ctx
+    bool supported(const context& ctx) {
+        #if defined(_WIN32) || defined(__APPLE__)
+            return false;
+        #else
+            return ctx.compiler_is_clang or ctx.compiler_is_gcc;
+        #endif
+    }
+
+    // Insert the options of the profile which apply to compile and link
+    // into cmd at index at, ahead of its sources.
+    // The dwp of binutils, used with gcc, only packs DWARF 4, so a build to
+    // be packed with it gets -gdwarf-4, unless it picks a version itself.
+    void insert_args(const context& ctx, command& cmd, size_t at, bool dwp) {
+        using namespace ::cxe::scan;
+        if (dwp and ctx.compiler_is_gcc and not cmd.find(prefix, token_t("-gdwarf", 7)))
+            cmd.insert(at++, token_t("-gdwarf-4", 9));
+
+        static const char* const options[] = {
+            "-gsplit-dwarf", "-ggnu-pubnames", "-gz",
+        };
+        for (const char* option : options) {
+            const token_t t { option, strlen(option) };
+            if (not cmd.find(equals, t)) cmd.insert(at++, t);
+        }
+    }
+
+    // append -Wl,--gdb-index to the link cmd if its linker can build one
+    void append_link_args(command& cmd) {
+        using namespace ::cxe::scan;
+        static const char* const linkers[] = {
+            "-fuse-ld=gold", "-fuse-ld=lld", "-fuse-ld=mold",
+        };
+        for (const char* linker : linkers) {
+            if (not cmd.find(equals, token_t(linker, strlen(linker)))) continue;
+            cmd.append(token_t("-Wl,--gdb-index", 15));
+            return;
+        }
+    }
+
+    // Remove the .dwo files of dir which belong to none of the objects.
+    void prune(const buffer<char>& dir, const commands& objects) {
+        using namespace ::cxe::scan;
+        buffer<buffer<char>> stale;
+        path::each(dir.data(), [&](const char* name) {
+            const token_t t { name, strlen(name) };
+            if (not suffix(".dwo", t)) return;
+            const token_t stem { name, t.size() - 4 };
+            for (const command* object : objects) {
+                token_t o { object->output(), strlen(object->output()) };
+                while (seek("/", o) and skip("/", o));
+                // the compiler replaces only the object extension, so the
+                // .dwo of glfw.x11.o is glfw.x11.dwo
+                if (not (chop(".o", o) or chop(".obj", o))) continue;
+                if (equals(stem, o)) return;
+            }
+            print_to(stale.emplace_back(), dir.data(), "/", name);
+        });
+        for (const buffer<char>& path : stale) path::remove(path.data());
+    }
+
+    // Set up cmd to pack the .dwo files of output into <output>.dwp.
+    // Returns false if the packaging tool is not found.
+    bool append_dwp(const context& ctx, command& cmd, const char* output) {
+        buffer<char> tool;
+        const char* const name = ctx.compiler_is_clang ? "llvm-dwp" : "dwp";
+        if (probe::which(tool, name)) return false;
+
+        buffer<char> dwp; dwp << output << ".dwp";
+        cmd.name(token_t("dwp", 3));
+        cmd.append(tool);
+        cmd.append(token_t("-e", 2));
+        cmd.append(token_t(output, strlen(output)));
+        cmd.append(token_t("-o", 2));
+        cmd.append(dwp);
+        cmd.output(dwp);
+        return true;
+    }
+
+} // namespace cxe::debug
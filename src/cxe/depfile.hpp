@@ -0,0 +1,59 @@
+#pragma once
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "scan.hpp"
+
+namespace cxe::depfile {
+
+    // Parse the Makefile rule emitted by -MD/-MMD and invoke fn(path) for
+    // each prerequisite.  Handles line continuations, escaped spaces ("\ ")
+    // and escaped dollar signs ("$$").  Targets are not reported.
+    template<typename Fn>
+    void parse(const buffer<char>& text, Fn&& fn) {
+        using namespace ::cxe::scan;
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+
+        bool in_prereqs = false;
+        buffer<char> path;
+
+        auto flush = [&]() {
+            if (path.empty()) return;
+            if (in_prereqs) fn(const_cast<const buffer<char>&>(path));
+            path.clear();
+        };
+
+        while (itr < end) {
+            const char c = *itr++;
+            if (c == '\\' and itr < end) {
+                const char d = *itr;
+                if (d == '\n') { ++itr; flush(); continue; }
+                if (d == '\r') { ++itr; skip('\n', itr, end); flush(); continue; }
+                if (d == ' ' or d == '#') { ++itr; path.push_back(d); continue; }
+                path.push_back(c);
+                continue;
+            }
+            if (c == '$' and itr < end and *itr == '$') {
+                ++itr; path.push_back('$');
+                continue;
+            }
+            if (c == ':' and not in_prereqs) {
+                // a colon followed by whitespace ends the target list;
+                // otherwise it is part of a path, e.g. "C:/foo.h"
+                if (itr == end or isspace(*itr)) {
+                    path.clear();
+                    in_prereqs = true;
+                    continue;
+                }
+            }
+            if (isspace(c)) {
+                flush();
+                if (c == '\n') in_prereqs = false;
+                continue;
+            }
+            path.push_back(c);
+        }
+        flush();
+    }
+
+} // namespace cxe::depfile
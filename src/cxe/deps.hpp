@@ -0,0 +1,207 @@
+#pragma once
+#include <stdint.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "depfile.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "path.hpp"
+#include "record.hpp"
+#include "scan.hpp"
+
+#ifdef _WIN32
+    #define getcwd _getcwd
+#endif
+
+// Up-to-date check for the compile command.
+//
+// The parser injects "-MMD -MF <output>.d" into the compile command.  After a
+// successful compile, the depfile is folded into a compact binary log next to
+// the output (<output>.cxedeps) holding a signature of the final command line
+// and the list of inputs.  On later runs the compile is skipped if the
+// signature matches and no input is newer than the output, which costs one
+// stat() per input and never re-parses the depfile text.
+//
+// The link of a multi-source build (see parser::fan_out()) is recorded the
+// same way, with the objects and libraries it names as its inputs, so it is
+// skipped when no object was rebuilt.
+
+namespace cxe::deps {
+
+    // resolve -l<name> against -L<dir> arguments, the way the linker would
+    bool find_library(
+        buffer<char>& out,
+        const buffer<const char*>& lib_dirs,
+        const char* name
+    ) {
+        static const char* const patterns[][2] = {
+            { "lib", ".so" }, { "lib", ".a" }, { "lib", ".dylib" },
+            { "lib", ".tbd" }, { "", ".lib" }, { "lib", ".lib" },
+        };
+        for (const char* lib_dir : lib_dirs) {
+            if (name[0] == ':') {
+                out.clear(); print_to(out, lib_dir, "/", name + 1);
+                if (path::stat(out.data()).exists) return true;
+                continue;
+            }
+            for (auto& pattern : patterns) {
+                out.clear();
+                print_to(out, lib_dir, "/", pattern[0], name, pattern[1]);
+                if (path::stat(out.data()).exists) return true;
+            }
+        }
+        return false;
+    }
+
+    // files named on the command line, e.g. sources, objects and libraries
+    void collect_file_args(buffer<buffer<char>>& paths, command& cmd) {
+        using namespace ::cxe::scan;
+        buffer<const char*> lib_dirs;
+        buffer<const char*> lib_names;
+
+        char** const argv = cmd.argv();
+        const size_t argc = cmd.argc();
+        for (size_t i = 1; i < argc; ++i) {
+            const char* const arg = argv[i];
+            const token_t t { arg, strlen(arg) };
+            const bool has_next = i + 1 < argc;
+
+            // skip outputs
+            if (equals("-o", t) or equals("-MF", t) or
+                equals("-MT", t) or equals("-MQ", t)) { ++i; continue; }
+            if (prefix("-o", t) or prefix("--output", t)) continue;
+
+            if (equals("-L", t) and has_next) { lib_dirs.push_back(argv[++i]); continue; }
+            if (prefix("-L", t)) { lib_dirs.push_back(arg + 2); continue; }
+            if (equals("-l", t) and has_next) { lib_names.push_back(argv[++i]); continue; }
+            if (prefix("-l", t)) { lib_names.push_back(arg + 2); continue; }
+            if (prefix("-", t)) continue;
+
+            const path::info info = path::stat(arg);
+            if (info and not info.dir) {
+                buffer<char>& p = paths.emplace_back();
+                p << arg;
+            }
+        }
+
+        for (const char* name : lib_names) {
+            buffer<char> found;
+            if (find_library(found, lib_dirs, name))
+                paths.emplace_back(std::move(found));
+        }
+
+        for (const buffer<char>& input : cmd.inputs()) {
+            paths.emplace_back() << input.data();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    static constexpr uint32_t MAGIC   = 0x44455843; // "CXED"
+    static constexpr uint32_t VERSION = 1;
+
+    buffer<char> log_path(const char* output) {
+        buffer<char> buf; buf << output << ".cxedeps";
+        return buf;
+    }
+
+    // path of the depfile requested by -MF, or empty
+    buffer<char> depfile_path(command& cmd) {
+        buffer<char> buf;
+        char** const argv = cmd.argv();
+        for (size_t i = 0; i + 1 < cmd.argc(); ++i) {
+            if (0 == strcmp(argv[i], "-MF")) {
+                buf << argv[i + 1];
+                break;
+            }
+        }
+        return buf;
+    }
+
+    // hash of the working directory and final command line
+    uint64_t signature(command& cmd) {
+        cxe::hash h;
+        h.update("cxe/deps/1");
+        char cwd[4096] = {0};
+        if (getcwd(cwd, sizeof(cwd))) h.update(cwd);
+        for (const char* arg : cmd) h.update(arg);
+        return h.digest();
+    }
+
+    // true if cmd has run before with the same signature, and none of its
+    // recorded inputs are missing or newer than its output
+    bool up_to_date(command& cmd) {
+        const char* const output = cmd.output();
+        if (not output[0]) return false;
+
+        buffer<char> data;
+        if (not file::load(log_path(output).data(), data)) return false;
+
+        record::reader r(data);
+        if (r.read<uint32_t>() != MAGIC)   return false;
+        if (r.read<uint32_t>() != VERSION) return false;
+        if (r.read<uint64_t>() != signature(cmd)) return false;
+
+        const path::info out = path::stat(output);
+        if (not out) return false;
+
+        const uint32_t n = r.read<uint32_t>();
+        buffer<char> input;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (not r.read_string(input)) return false;
+            const path::info in = path::stat(input.data());
+            if (not in or in.mtime > out.mtime) return false;
+        }
+        return bool(r);
+    }
+
+    // Fold the depfile of a successful compile into the binary log.  A link
+    // has no depfile, its inputs are the objects and libraries it names.
+    bool record(command& cmd) {
+        const char* const output = cmd.output();
+        if (not output[0]) return false;
+
+        const buffer<char> dep_path = depfile_path(cmd);
+        if (dep_path.empty() and cmd.kind() != command::link) return false;
+
+        buffer<char> text;
+        if (dep_path.size() and not file::load(dep_path.data(), text))
+            return false;
+
+        buffer<buffer<char>> paths;
+
+        // the compiler itself, when named by absolute path
+        if (path::absolute(cmd.argv()[0])) {
+            paths.emplace_back() << cmd.argv()[0];
+        }
+
+        collect_file_args(paths, cmd);
+        depfile::parse(text, [&](const buffer<char>& p) {
+            for (const buffer<char>& q : paths)
+                if (0 == strcmp(p.data(), q.data())) return;
+            // skip the phony targets of gcc's module dependencies, e.g.
+            // "hello.c++m", and the "|" of order-only prerequisites
+            if (not path::stat(p.data()).exists) return;
+            paths.emplace_back() << p;
+        });
+
+        buffer<char> data;
+        record::writer w(data);
+        w.write(MAGIC);
+        w.write(VERSION);
+        w.write(signature(cmd));
+        w.write(uint32_t(paths.size()));
+        for (const buffer<char>& p : paths) w.write_string(p.data(), p.size());
+
+        if (not file::save(log_path(output).data(), data.data(), data.size()))
+            return false;
+
+        // the injected depfile has served its purpose
+        buffer<char> injected; injected << output << ".d";
+        if (dep_path.size() and 0 == strcmp(injected.data(), dep_path.data()))
+            path::remove(dep_path.data());
+        return true;
+    }
+
+} // namespace cxe::deps
@@ -0,0 +1,82 @@
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "environment.hpp"
+#include "path.hpp"
+#include "scan.hpp"
+
+// Shared libraries for dependencies while iterating, with -dev-shared.
+//
+// A dependency built by "-pre { $CXE glfw3.c }" with "-c -o libglfw3.a" is
+// linked into every program statically, so every relink copies all of it.
+// With -dev-shared, which reaches nested cxe processes as CXE_DEV_SHARED=1,
+// such a build instead compiles with -shared -fPIC to libglfw3.so, or
+// libglfw3.dylib on macOS, beside the archive, which the linker prefers for
+// -lglfw3, and the program links with an rpath to each -L directory, so
+// that it runs from where it was built.
+//
+// Without -dev-shared, the build of an archive removes the shared library
+// beside it, so that the program links the archive again.  Windows, where a
+// DLL needs an import library and exports, keeps static linking.
+
+namespace cxe::devshared {
+
+    // whether this cxe, or the cxe which started it, has -dev-shared
+    bool enabled() {
+        #if defined(_WIN32)
+            return false;
+        #else
+            const char* const value = getenv("CXE_DEV_SHARED");
+            return value and 0 == strcmp(value, "1");
+        #endif
+    }
+
+    // pass -dev-shared on to nested cxe processes
+    void enable() {
+        // putenv() retains the string, so the variable must outlive us
+        new environment::variable("CXE_DEV_SHARED", "1");
+    }
+
+    // For an archive output, e.g. dir/libname.a, the shared library which
+    // stands in for it, dir/libname.so or dir/libname.dylib, or else empty.
+    buffer<char> library(const char* output) {
+        using namespace ::cxe::scan;
+        buffer<char> path;
+        token_t name { output, strlen(output) };
+        while (seek("/", name) and skip("/", name));
+        if (not prefix("lib", name) or not suffix(".a", name)) return path;
+        path << token_t(output, name.data() + name.size() - 2);
+        #if defined(__APPLE__)
+            path << ".dylib";
+        #else
+            path << ".so";
+        #endif
+        return path;
+    }
+
+    // insert -Wl,-rpath,<dir> into the link cmd at index at, for each
+    // -L<dir> or -L <dir>
+    void insert_rpaths(command& cmd, size_t at) {
+        using namespace ::cxe::scan;
+        buffer<buffer<char>> dirs;
+        char** const argv = cmd.argv();
+        const size_t argc = cmd.argc();
+        for (size_t i = 1; i < argc; ++i) {
+            token_t t { argv[i], strlen(argv[i]) };
+            if (not skip("-L", t)) continue;
+            if (t.empty() and i + 1 < argc) { ++i; t = token_t(argv[i], strlen(argv[i])); }
+            if (t.empty()) continue;
+            buffer<char>& dir = dirs.emplace_back();
+            dir << t;
+            path::qualify(dir);
+        }
+        for (const buffer<char>& dir : dirs) {
+            buffer<char> arg; arg << "-Wl,-rpath," << dir.data();
+            cmd.insert(at++, arg);
+        }
+    }
+
+} // namespace cxe::devshared
@@ -1,6 +1,16 @@
 #pragma once
 #include <stdio.h>
 #include "verify.hpp"
+#include "buffer.hpp"
+#include "path.hpp"
+#include "print.hpp"
+
+#ifdef _WIN32
+    #include <process.h> // _getpid
+    #define getpid _getpid
+#else
+    #include <unistd.h>  // getpid
+#endif
 
 namespace cxe {
 
@@ -41,7 +51,9 @@ namespace cxe {
         }
 
         // move constructor
-        file(file&& src) : stream(src.stream) { new(&src) file(); }
+        file(file&& src) : stream(src.stream), closef(src.closef) {
+            new(&src) file();
+        }
 
         file& operator=(file&& src) {
             if (this != &src) {
@@ -92,6 +104,58 @@ namespace cxe {
             return fread(dst, sizeof(char), len, stream);
         }
 
+        size_t write(const void* src, size_t len) {
+            if (not stream) return 0;
+
+            return fwrite(src, sizeof(char), len, stream);
+        }
+
+        // read entire contents of filename into dst
+        static bool load(const char* filename, buffer<char>& dst) {
+            file f { filename, "rb" };
+            if (f.closed()) return false;
+
+            const size_t size = f.size();
+            dst.resize(size);
+            if (size == 0) return true;
+            const size_t n = fread(dst.data(), sizeof(char), size, f);
+            dst.resize(n);
+            return n == size;
+        }
+
+        // write src to a temporary file, then rename it to filename,
+        // so that concurrent readers never observe a partial file
+        static bool save(
+            const char* filename,
+            const void* src,
+            size_t      len,
+            bool        exec = false
+        ) {
+            buffer<char> tmp;
+            print_to(tmp, filename, ".", (unsigned long long)getpid(), ".tmp");
+            {
+                file f { tmp.data(), "wb" };
+                if (f.closed()) return false;
+                if (len and f.write(src, len) != len) {
+                    f.close();
+                    path::remove(tmp.data());
+                    return false;
+                }
+            }
+            #if not defined(_WIN32)
+                if (exec) chmod(tmp.data(), 0755);
+            #endif
+            return path::rename(tmp.data(), filename);
+        }
+
+        // copy src to dst via file::save, preserving the executable bit
+        static bool copy(const char* src, const char* dst) {
+            buffer<char> buf;
+            if (not load(src, buf)) return false;
+            const bool exec = path::stat(src).exec;
+            return save(dst, buf.data(), buf.size(), exec);
+        }
+
         template<size_t N>
         bool seek(const char (&str)[N]) {
             static_assert(N > 0);
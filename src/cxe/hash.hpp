@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <span>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "file.hpp"
+
+namespace cxe {
+
+    // 64-bit non-cryptographic hash used to derive cache keys and signatures
+    class hash {
+        uint64_t _state  = 0x9E3779B97F4A7C15ull;
+        uint64_t _length = 0;
+
+        static constexpr uint64_t K1 = 0x87C37B91114253D5ull;
+        static constexpr uint64_t K2 = 0x4CF5AD432745937Full;
+
+        static uint64_t rotl(uint64_t x, int r) {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        static uint64_t fmix(uint64_t h) {
+            h ^= h >> 33; h *= 0xFF51AFD7ED558CCDull;
+            h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+        void round(uint64_t w) {
+            _state ^= rotl(w * K1, 31) * K2;
+            _state = rotl(_state, 27) * 5 + 0x52DCE729;
+        }
+
+    public:
+
+        hash() = default;
+
+        hash& update(const void* data, size_t size) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            const uint8_t* const end = p + size;
+            for (; p + 8 <= end; p += 8) {
+                uint64_t w; memcpy(&w, p, 8);
+                round(w);
+            }
+            uint64_t w = 0;
+            for (int shift = 0; p < end; ++p, shift += 8) {
+                w |= uint64_t(*p) << shift;
+            }
+            round(w ^ size);
+            _length += size;
+            return *this;
+        }
+
+        hash& update(uint64_t value) { return update(&value, sizeof(value)); }
+
+        hash& update(int64_t value) { return update(&value, sizeof(value)); }
+
+        // include the nul terminator, so ("ab","c") and ("a","bc") differ
+        hash& update(const char* str) { return update(str, strlen(str) + 1); }
+
+        hash& update(const std::span<const char>& span) {
+            update(span.data(), span.size());
+            return update(uint64_t(span.size()));
+        }
+
+        // hash the entire contents of a file, returns false if unreadable
+        bool update_file(const char* path) {
+            file f { path, "rb" };
+            if (f.closed()) return false;
+            char buf[64 * 1024];
+            while (const size_t n = fread(buf, sizeof(char), sizeof(buf), f)) {
+                update(buf, n);
+            }
+            update(uint64_t(f.tell()));
+            return true;
+        }
+
+        uint64_t digest() const { return fmix(_state ^ fmix(_length)); }
+
+        // format value as 16 lowercase hex digits
+        static const char* format(char (&dst)[17], uint64_t value) {
+            static constexpr char digits[] = "0123456789abcdef";
+            for (int i = 15; i >= 0; --i, value >>= 4) {
+                dst[i] = digits[value & 0xF];
+            }
+            dst[16] = 0;
+            return dst;
+        }
+
+        static bool parse(const char* src, uint64_t& value) {
+            value = 0;
+            for (int i = 0; i < 16; ++i) {
+                const char c = src[i];
+                const int d =
+                    (c >= '0' and c <= '9') ? c - '0' :
+                    (c >= 'a' and c <= 'f') ? c - 'a' + 10 : -1;
+                if (d < 0) return false;
+                value = (value << 4) | uint64_t(d);
+            }
+            return true;
+        }
+    };
+
+} // namespace cxe
@@ -0,0 +1,198 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verify.hpp"
+#include "async.hpp"
+#include "buffer.hpp"
+#include "environment.hpp"
+#include "print.hpp"
+#include "scan.hpp"
+
+#if not defined(_WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// A GNU make compatible jobserver, shared by every cxe, make and ninja
+// process in one build, so that nested "$CXE dep.c" invocations do not each
+// run their own -j jobs at once.
+//
+// The top-level cxe creates a pipe holding one token per job slot, less the
+// slot every process holds implicitly.  Children inherit both ends of the
+// pipe, which is advertised to them in the form every GNU make since 4.2
+// and ninja understand:
+//
+//     MAKEFLAGS=" -j<jobs> --jobserver-auth=<read fd>,<write fd>"
+//
+// A process reads one token before running each job beyond its first, and
+// writes it back when that job finishes.  When cxe itself runs under make,
+// it joins make's jobserver instead, including the "fifo:<path>" form of
+// make 4.4.
+//
+// On Windows, where commands run one at a time, the jobserver is inert.
+
+namespace cxe::jobserver {
+
+    class client {
+        int          _read  = -1; // non-blocking, private to this process
+        int          _write = -1;
+        int          _pipe  = -1; // read end of the pipe, if we created it
+        buffer<char> _held;       // tokens read, to be written back
+        bool         _implicit = true; // whether our own slot is free
+        bool         _serial   = false;
+
+        environment::variable* _makeflags = nullptr;
+
+        client(const client&) = delete;
+        client& operator=(const client&) = delete;
+
+        #if not defined(_WIN32)
+
+        // Open a non-blocking descriptor for the read end of a shared pipe.
+        // On Linux, reopening it through /proc creates a new open file
+        // description, so other readers of the pipe are not affected.
+        static int open_nonblocking(int fd) {
+            #if defined(__linux__)
+                char proc_path[64];
+                snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+                const int r = open(proc_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+                if (r >= 0) return r;
+            #endif
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            return fd;
+        }
+
+        // parse the last --jobserver-auth= (or --jobserver-fds=) in flags
+        bool join(const char* flags) {
+            const char* auth = nullptr;
+            for (const char* key : { "--jobserver-auth=", "--jobserver-fds=" }) {
+                for (const char* p = flags; (p = strstr(p, key)); p += strlen(key)) {
+                    if (not auth or p > auth) auth = p + strlen(key);
+                }
+            }
+            if (not auth) return false;
+
+            const char* const end = auth + strcspn(auth, " ");
+            buffer<char> value; value << scan::span_t(auth, end - auth);
+
+            if (scan::prefix("fifo:", value)) {
+                _read = open(value.data() + 5, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+                _write = _read;
+                return _read >= 0;
+            }
+
+            int r = -1, w = -1;
+            if (2 != sscanf(value.data(), "%d,%d", &r, &w)) return false;
+
+            // the fds are only valid if make passed them on to us
+            if (fcntl(r, F_GETFD) < 0 or fcntl(w, F_GETFD) < 0) return false;
+
+            _read = open_nonblocking(r);
+            _write = w;
+            return true;
+        }
+
+        // create the pipe, and fill it with tokens for jobs - 1 slots
+        bool serve(size_t jobs) {
+            int fds[2];
+            if (pipe(fds)) return false;
+
+            for (size_t i = 1; i < jobs; ++i) {
+                if (1 != ::write(fds[1], "+", 1)) break;
+            }
+
+            _pipe = fds[0];
+            _read = open_nonblocking(fds[0]);
+            _write = fds[1];
+
+            const char* const flags = getenv("MAKEFLAGS");
+            _makeflags = new environment::variable("MAKEFLAGS",
+                flags ? flags : "", " -j", jobs,
+                " --jobserver-auth=", fds[0], ",", fds[1]);
+            return true;
+        }
+
+        #endif
+
+    public:
+
+        // join the jobserver of our parent, or else serve jobs slots
+        explicit client(size_t jobs) {
+            #if defined(_WIN32)
+                (void)jobs;
+            #else
+                const char* const flags = getenv("MAKEFLAGS");
+                if (flags and join(flags)) return;
+                if (flags and strstr(flags, "--jobserver-")) {
+                    // our parent runs a jobserver we cannot reach; like
+                    // make, run one job at a time rather than oversubscribe
+                    _serial = true;
+                    return;
+                }
+                serve(jobs);
+            #endif
+        }
+
+        ~client() {
+            #if not defined(_WIN32)
+                for (const char c : _held) { if (::write(_write, &c, 1)) {} }
+                if (_read >= 0) close(_read);
+                if (_write >= 0 and _write != _read) close(_write);
+                if (_pipe >= 0 and _pipe != _read) close(_pipe);
+            #endif
+            // MAKEFLAGS is left in place, putenv() retains its string
+        }
+
+        explicit operator bool() const { return _read >= 0; }
+
+        // whether jobs must run one at a time, for want of a jobserver
+        bool serial() const { return _serial; }
+
+        // Acquire a job slot.  Yields 1 if a token was read, which must be
+        // returned with release(true), or 0 if the implicit slot was taken,
+        // or there is no jobserver, to be returned with release(false).
+        async::task acquire(async::loop& loop) {
+            if (_read < 0) co_return false;
+
+            if (_implicit) {
+                _implicit = false;
+                co_return false;
+            }
+
+            #if not defined(_WIN32)
+                for (;;) {
+                    char c = 0;
+                    const ssize_t n = ::read(_read, &c, 1);
+                    if (n == 1) {
+                        _held.push_back(c);
+                        co_return true;
+                    }
+                    if (n < 0 and errno != EAGAIN and errno != EINTR) {
+                        co_return false;
+                    }
+                    co_await loop.readable(_read);
+                }
+            #else
+                (void)loop;
+                co_return false;
+            #endif
+        }
+
+        void release(bool token) {
+            if (_read < 0) return;
+            if (not token) {
+                _implicit = true;
+                return;
+            }
+            #if not defined(_WIN32)
+                verify(_held.size());
+                const char c = _held.back();
+                _held.pop_back();
+                while (::write(_write, &c, 1) < 0 and errno == EINTR);
+            #endif
+        }
+    };
+
+} // namespace cxe::jobserver
@@ -0,0 +1,175 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "print.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// Selection of the fastest available linker.
+//
+// Unless the build pins a linker with -fuse-ld= or --ld-path=, the link of
+// a clang or gcc build gets -fuse-ld=<linker> for the first of mold, lld and
+// gold which the compiler can drive, falling back to the default linker if
+// none can.  Whether the compiler can drive a linker is probed by having it
+// print the version of the linker, once per compiler and PATH, and cached
+// with the other probes (see probe.hpp).
+//
+// "cxe <source> --link-bench" builds the program, then times its link with
+// each available linker, and records the fastest, which then takes
+// precedence over the default order for every build with the compiler.
+
+namespace cxe::linker {
+
+    // candidates, fastest first; "default" is the compiler's own choice
+    static constexpr const char* const CANDIDATES[] = { "mold", "lld", "gold" };
+
+    static constexpr const char DEFAULT[] = "default";
+
+    using span_t = std::span<const char>;
+
+    span_t env_path() {
+        const char* const path = getenv("PATH");
+        return path ? span_t(path, strlen(path)) : span_t();
+    }
+
+    // whether the arguments of cmd already choose a linker
+    bool pinned(const command& cmd) {
+        using namespace ::cxe::scan;
+        return cmd.find(prefix, token_t("-fuse-ld=", 9))
+            or cmd.find(prefix, token_t("--ld-path=", 10));
+    }
+
+    // whether cmd links, rather than only compiles, preprocesses, etc.
+    bool links(const command& cmd) {
+        using namespace ::cxe::scan;
+        if (cmd.kind() == command::link) return true;
+        if (cmd.kind() != command::compile) return false;
+        static const char* const options[] = {
+            "-c", "-S", "-E", "-M", "-MM", "-fsyntax-only", "-emit-llvm", "-###",
+        };
+        for (const char* option : options)
+            if (cmd.find(equals, token_t(option, strlen(option)))) return false;
+        return true;
+    }
+
+    // whether compiler runs with -fuse-ld=<name>
+    bool supported(span_t compiler, const char* name) {
+        buffer<char> compiler_path; compiler_path << compiler;
+        probe::unquote(compiler_path);
+        buffer<char> use_ld; use_ld << "-fuse-ld=" << name;
+        char* argv[] = {
+            compiler_path.data(),
+            use_ld.data(),
+            const_cast<char*>("-Wl,--version"),
+            nullptr
+        };
+        // the diagnostics of a missing linker are expected, and discarded
+        buffer<char> output;
+        return 0 == shell::capture_argv(output, argv, true);
+    }
+
+    // The linker for builds with compiler: the winner of --link-bench, or
+    // else the first supported candidate, or DEFAULT.
+    buffer<char> select(const context& ctx) {
+        buffer<char> name;
+
+        #if defined(_WIN32) || defined(__APPLE__)
+            name << DEFAULT;
+            return name;
+        #else
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc)) {
+                name << DEFAULT;
+                return name;
+            }
+
+            if (probe::lookup(probe::key("link-bench", ctx.compiler_path, env_path()), name))
+                return name;
+
+            const uint64_t k = probe::key("linker", ctx.compiler_path, env_path());
+            if (probe::lookup(k, name)) return name;
+
+            for (const char* candidate : CANDIDATES) {
+                if (not supported(ctx.compiler_path, candidate)) continue;
+                name << candidate;
+                break;
+            }
+            if (name.empty()) name << DEFAULT;
+            probe::store(k, name);
+            return name;
+        #endif
+    }
+
+    // append -fuse-ld=<linker> to the link cmd, unless the build pins one
+    void append_arg(const context& ctx, command& cmd) {
+        if (pinned(cmd)) return;
+        const buffer<char> name = select(ctx);
+        if (0 == strcmp(name.data(), DEFAULT)) return;
+        buffer<char> arg; arg << "-fuse-ld=" << name.data();
+        cmd.append(arg);
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Time the link of cmd with each linker the compiler supports, and record
+    // the fastest for select().  Returns non-zero if no linker succeeded.
+    int bench(const context& ctx, command& cmd) {
+        using namespace ::cxe::scan;
+        using clock = std::chrono::steady_clock;
+        constexpr int RUNS = 3;
+
+        // the arguments of cmd, less any -fuse-ld= chosen for it
+        buffer<char*> args;
+        for (char* arg : cmd) {
+            if (prefix("-fuse-ld=", token_t(arg, strlen(arg)))) continue;
+            args.push_back(arg);
+        }
+
+        const char* names[1 + sizeof(CANDIDATES) / sizeof(*CANDIDATES)];
+        size_t count = 0;
+        names[count++] = DEFAULT;
+        for (const char* candidate : CANDIDATES) {
+            if (supported(ctx.compiler_path, candidate)) names[count++] = candidate;
+        }
+
+        const char* winner = nullptr;
+        double best = 0;
+        for (size_t i = 0; i < count; ++i) {
+            buffer<char> use_ld; use_ld << "-fuse-ld=" << names[i];
+            buffer<char*> argv;
+            for (char* arg : args) argv.push_back(arg);
+            if (names[i] != DEFAULT) argv.push_back(use_ld.data());
+            argv.push_back(nullptr);
+
+            // the fastest of RUNS, which least reflects noise of the host
+            double ms = 0;
+            int status = 0;
+            for (int run = 0; run < RUNS and not status; ++run) {
+                const auto start = clock::now();
+                status = shell::run_argv(argv.data());
+                const std::chrono::duration<double, std::milli> took = clock::now() - start;
+                if (run == 0 or took.count() < ms) ms = took.count();
+            }
+
+            if (status) { println(names[i], ": failed"); continue; }
+
+            char text[32]; snprintf(text, sizeof(text), "%.1f ms", ms);
+            println(names[i], ": ", text);
+            if (not winner or ms < best) { winner = names[i]; best = ms; }
+        }
+
+        if (not winner) return 1;
+
+        buffer<char> value; value << winner;
+        probe::store(probe::key("link-bench", ctx.compiler_path, env_path()), value);
+        println("fastest: ", winner);
+        return 0;
+    }
+
+} // namespace cxe::linker
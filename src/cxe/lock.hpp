@@ -0,0 +1,80 @@
+#pragma once
+#include <errno.h>
+#include "verify.hpp"
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+    #include <sys/locking.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <unistd.h>
+#endif
+
+// Exclusive locks of files, shared between cxe processes, e.g. of the
+// cache directory.  The file is created if need be, and never removed.
+// A lock whose file cannot be opened holds nothing, and never waits.
+
+namespace cxe {
+
+    // exclusive lock of a file, held for the lifetime of the lock
+    class lock {
+        int  _fd   = -1;
+        bool _held = false;
+
+        lock(const lock&) = delete;
+        lock& operator=(const lock&) = delete;
+
+        bool acquire(bool wait) {
+            if (_fd < 0 or _held) return _held;
+            #if defined(_WIN32)
+                // _LK_LOCK retries once a second for 10 seconds
+                const int mode = wait ? _LK_LOCK : _LK_NBLCK;
+                while (not _held) {
+                    _held = 0 == _locking(_fd, mode, 1);
+                    if (not wait) break;
+                }
+            #else
+                const int mode = wait ? LOCK_EX : LOCK_EX | LOCK_NB;
+                int r;
+                while ((r = flock(_fd, mode)) != 0 and errno == EINTR);
+                _held = r == 0;
+            #endif
+            return _held;
+        }
+
+    public:
+
+        // take the lock, waiting for it unless not wait
+        explicit lock(const char* path, bool wait = true) {
+            #if defined(_WIN32)
+                _fd = _open(path, _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE);
+            #else
+                _fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+            #endif
+            acquire(wait);
+        }
+
+        ~lock() {
+            if (_fd < 0) return;
+            #if defined(_WIN32)
+                if (_held) {
+                    _lseek(_fd, 0, SEEK_SET);
+                    _locking(_fd, _LK_UNLCK, 1);
+                }
+                _close(_fd);
+            #else
+                close(_fd);
+            #endif
+        }
+
+        // whether another process holds the lock, see retry()
+        bool waiting() const { return _fd >= 0 and not _held; }
+
+        // try again to take the lock, without waiting
+        bool retry() { return acquire(false); }
+    };
+
+} // namespace cxe
@@ -0,0 +1,193 @@
+#pragma once
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "pch.hpp"
+#include "print.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// Programs built for several x86 -march levels, with -march-variants=.
+//
+// With -march-variants=x86-64-v2,x86-64-v3,x86-64-v4, the program is built
+// once per level, by nested cxe processes running concurrently, to
+// <output>.<level>, and the output itself is a small launcher, generated
+// to <output dir>/.cxe/<source name>-march/launcher.c, which on startup
+// executes the variant of the last level the CPU supports, with the same
+// arguments.  So -o names the program to ship and run, with its variants
+// beside it, and -- runs the launcher like any other program.
+//
+// The launcher tests the CPU for the instruction set extensions which the
+// compiler enables for each level, as found by its predefined macros, with
+// __builtin_cpu_supports(), so any -march= the compiler knows, e.g.
+// haswell, works as a level.  A level enabling none is always supported.
+
+namespace cxe::march {
+
+    // predefined macro of an extension, and its __builtin_cpu_supports() name
+    struct feature {
+        const char* macro;
+        const char* name;
+    };
+
+    static constexpr feature FEATURES[] = {
+        { "__SSE3__",       "sse3"       },
+        { "__SSSE3__",      "ssse3"      },
+        { "__SSE4_1__",     "sse4.1"     },
+        { "__SSE4_2__",     "sse4.2"     },
+        { "__POPCNT__",     "popcnt"     },
+        { "__AVX__",        "avx"        },
+        { "__AVX2__",       "avx2"       },
+        { "__FMA__",        "fma"        },
+        { "__BMI__",        "bmi"        },
+        { "__BMI2__",       "bmi2"       },
+        { "__AVX512F__",    "avx512f"    },
+        { "__AVX512BW__",   "avx512bw"   },
+        { "__AVX512CD__",   "avx512cd"   },
+        { "__AVX512DQ__",   "avx512dq"   },
+        { "__AVX512VL__",   "avx512vl"   },
+        { "__AVX512VNNI__", "avx512vnni" },
+    };
+
+    // The extensions enabled by -march=<level>, as names separated by
+    // spaces, probed once per compiler and level.  Returns non-zero if the
+    // compiler rejects the level.
+    int features(buffer<char>& out, probe::span_t compiler, const char* level) {
+        const uint64_t k = probe::key("march", compiler, { level, strlen(level) });
+        if (probe::lookup(k, out)) return 0;
+
+        buffer<char> compiler_path; compiler_path << compiler;
+        probe::unquote(compiler_path);
+        buffer<char> march; march << "-march=" << level;
+        char* argv[] = {
+            compiler_path.data(),
+            march.data(),
+            const_cast<char*>("-dM"),
+            const_cast<char*>("-E"),
+            const_cast<char*>("-x"),
+            const_cast<char*>("c"),
+            const_cast<char*>("/dev/null"),
+            nullptr
+        };
+        buffer<char> macros;
+        if (const int status = shell::capture_argv(macros, argv)) return status;
+
+        buffer<char> names;
+        for (const feature& f : FEATURES) {
+            buffer<char> define; define << "#define " << f.macro << " ";
+            if (not strstr(macros.data(), define.data())) continue;
+            if (names.size()) names << " ";
+            names << f.name;
+        }
+        probe::store(k, names);
+        if (names.size()) out << names.data();
+        return 0;
+    }
+
+    // <output>.<level>, the variant of the program for level
+    buffer<char> variant_path(const char* output, const buffer<char>& level) {
+        buffer<char> path; path << output << "." << level.data();
+        return path;
+    }
+
+    // make cmd, which holds the arguments of this cxe, the build of the
+    // variant of output for level
+    void append_variant_args(command& cmd, const char* output, const buffer<char>& level) {
+        buffer<char> name; name << "march-" << level.data();
+        cmd.name(name);
+        cmd.append(token_t("--march-variant", 15));
+        cmd.append(level);
+        cmd.output(variant_path(output, level));
+    }
+
+    // append the arguments which compile the program for level to cmd
+    void append_level_args(command& cmd, const buffer<char>& level) {
+        buffer<char> arg; arg << "-march=" << level.data();
+        cmd.append(arg);
+    }
+
+    // append the arguments which compile the launcher to output to cmd,
+    // which holds the compiler; it takes none of the flags of the program
+    void append_launcher_args(command& cmd, const char* launcher, const buffer<char>& output) {
+        cmd.append(token_t("-O2", 3));
+        cmd.append(token_t(launcher, strlen(launcher)));
+        cmd.append(token_t("-o", 2));
+        cmd.append(output);
+        cmd.output(output);
+    }
+
+    // Write the launcher to path, unless it already holds it, given the
+    // levels and the features of each.  Returns false on failure.
+    bool write_launcher(
+        const char* path,
+        const buffer<buffer<char>>& levels,
+        const buffer<buffer<char>>& features
+    ) {
+        verify(levels.size() == features.size());
+        buffer<char> text;
+        text << "// generated by cxe for -march-variants=, see march.hpp\n";
+        text << "#include <stdio.h>\n";
+        text << "#include <stdlib.h>\n";
+        text << "#include <string.h>\n";
+        text << "#include <unistd.h>\n";
+        text << "#if defined(__APPLE__)\n";
+        text << "#include <mach-o/dyld.h>\n";
+        text << "#endif\n\n";
+
+        // the last level first, the preferred one
+        text << "static const char* const suffixes[] = {\n";
+        for (size_t i = levels.size(); i-- > 0;)
+            text << "    \"." << levels[i].data() << "\",\n";
+        text << "};\n\n";
+
+        text << "static int supported(int level) {\n";
+        text << "    __builtin_cpu_init();\n";
+        text << "    switch (level) {\n";
+        for (size_t i = levels.size(), n = 0; i-- > 0; ++n) {
+            print_to(text, "    case ", n, ": return 1");
+            const char* name = features[i].data();
+            while (name and *name) {
+                const char* const space = strchr(name, ' ');
+                const size_t size = space ? size_t(space - name) : strlen(name);
+                text << "\n        && __builtin_cpu_supports(\"" << token_t(name, size) << "\")";
+                name = space ? space + 1 : nullptr;
+            }
+            text << ";\n";
+        }
+        text << "    }\n";
+        text << "    return 0;\n";
+        text << "}\n\n";
+
+        text << R"(int main(int argc, char* argv[]) {
+    (void)argc;
+    char self[4096];
+    size_t size = 0;
+#if defined(__linux__)
+    const ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 64);
+    if (n > 0) size = (size_t)n;
+#elif defined(__APPLE__)
+    uint32_t capacity = sizeof(self) - 64;
+    if (0 == _NSGetExecutablePath(self, &capacity)) size = strlen(self);
+#endif
+    if (size == 0) {
+        size = strlen(argv[0]);
+        if (size >= sizeof(self) - 64) return 127;
+        memcpy(self, argv[0], size);
+    }
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(*suffixes); ++i) {
+        if (!supported((int)i)) continue;
+        strcpy(self + size, suffixes[i]);
+        execv(self, argv);
+        perror(self);
+        return 127;
+    }
+    fprintf(stderr, "%s: no variant supports this CPU\n", argv[0]);
+    return 127;
+}
+)";
+        return pch::write_header(path, text);
+    }
+
+} // namespace cxe::march
@@ -0,0 +1,247 @@
+#pragma once
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "file.hpp"
+#include "path.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// C++20 named modules across the sources of a multi-source build.
+//
+// Each source is scanned for its module declaration and imports:
+//
+//     export module net;          // interface of module net
+//     export module net:tcp;      // interface of partition net:tcp
+//     module net;                 // implementation of net, imports net
+//     import net;                 // imports net
+//     import :tcp;                // within module net, imports net:tcp
+//
+// The compile of an interface also writes its built module interface (BMI)
+// to the object store of the build, which is keyed on the flags of the
+// build (see parser::store_dir()), and is ordered before every compile that
+// imports it.
+//
+// The std and std.compat modules, when imported and not provided by a source
+// of the build, are built like the other interfaces, from the sources the
+// standard library ships, which the module manifest of the compiler names:
+//
+//   - clang: <cc> -print-library-module-manifest-path, e.g. the
+//     libc++.modules.json of libc++ 19, which needs -stdlib=libc++
+//   - gcc: <cc> -print-file-name=libstdc++.modules.json, since gcc 15
+//
+// So a single source importing std is built as a multi-source build, whose
+// std BMI and object are kept in the object store with those of its flags.
+// Other modules not provided by any source of the build, and header units
+// (import <vector>; and import "file.h";), are left to the compiler.
+//
+//   - clang: the interface writes <store>/<module>.pcm (partition a:b as
+//     a-b.pcm) via -fmodule-output=, and every compile finds the interfaces
+//     it imports via -fprebuilt-module-path=<store>.  Interfaces in files
+//     other than .cppm or .ixx are compiled with -x c++-module.
+//   - gcc: every compile gets -fmodules-ts and -fmodule-mapper=<store>/
+//     modules.map, which maps each module to <store>/<module>.gcm.
+
+namespace cxe::modules {
+
+    struct unit {
+        buffer<char>         name;    // module declared, if any
+        buffer<buffer<char>> imports; // modules imported
+        bool                 exports = false; // whether it builds a BMI
+    };
+
+    // Scan the module declaration and imports of the source at path.  Only
+    // declarations at the start of a line, outside comments, are seen.
+    // Returns false if the source neither declares nor imports a module.
+    bool scan(unit& u, const char* path) {
+        using namespace ::cxe::scan;
+        buffer<char> text;
+        if (not file::load(path, text)) return false;
+
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+
+        auto is_name_char = [](char c) {
+            return isalnum(c) or c == '_' or c == '.' or c == ':';
+        };
+
+        while (itr < end) {
+            skip_while(isspace, itr, end);
+
+            if (skip("//", itr, end)) { seek('\n', itr, end); continue; }
+            if (skip("/*", itr, end)) {
+                if (not seek("*/", itr, end)) break;
+                skip("*/", itr, end);
+                continue;
+            }
+
+            itr_t line = itr;
+            seek('\n', itr, end);
+            itr_t p = line;
+
+            const bool exports = skip("export", p, itr) and skip_while(isblank, p, itr);
+            if (not exports) p = line;
+
+            const bool is_module = skip("module", p, itr);
+            const bool is_import = not is_module and skip("import", p, itr);
+            if (not (is_module or is_import)) continue;
+            if (not skip_while(isblank, p, itr) and not prefix(':', p, itr))
+                continue; // e.g. "modules_init();"
+
+            itr_t name = p;
+            skip_while(is_name_char, p, itr);
+            skip_while(isblank, p, itr);
+            if (not prefix(';', p, itr)) continue; // e.g. import <vector>;
+            const token_t t { name, p };
+            if (t.empty()) continue; // "module;" begins the global fragment
+
+            if (is_module) {
+                if (equals(":private", t)) continue;
+                u.name.clear();
+                u.name << t;
+                // partitions are importable, whether exported or not
+                u.exports = exports or contains(":", t);
+                // an implementation unit imports its interface
+                if (not u.exports) u.imports.emplace_back() << t;
+                continue;
+            }
+
+            buffer<char>& import = u.imports.emplace_back();
+            if (t[0] == ':') {
+                // a partition of the module of this unit
+                const char* const colon = strchr(u.name.data(), ':');
+                const size_t n = colon ? colon - u.name.data() : u.name.size();
+                import << token_t(u.name.data(), n);
+            }
+            import << t;
+        }
+
+        return u.name.size() or u.imports.size();
+    }
+
+    // name of the scheduler job which builds the interface of module
+    buffer<char> job_name(const buffer<char>& module) {
+        buffer<char> buf; buf << "module " << module.data();
+        return buf;
+    }
+
+    // <store>/<module><ext>, with the partition separator replaced by "-"
+    buffer<char> bmi_path(const buffer<char>& store, const buffer<char>& module, const char* ext) {
+        buffer<char> buf; buf << store.data() << "/";
+        for (const char c : module) buf.push_back(c == ':' ? '-' : c);
+        buf << ext;
+        return buf;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // whether module is one of the standard library, see above
+    bool is_std(const buffer<char>& module) {
+        return 0 == strcmp(module.data(), "std") or 0 == strcmp(module.data(), "std.compat");
+    }
+
+    // a module of the manifest of the standard library
+    struct std_module {
+        buffer<char>         name;     // "logical-name"
+        buffer<char>         source;   // "source-path"
+        buffer<buffer<char>> includes; // "system-include-directories"
+    };
+
+    // The path of the module manifest of the standard library of compiler,
+    // with -stdlib=<lib> if not empty, probed once per compiler and stdlib.
+    // Returns false if the compiler names none.
+    bool manifest_path(
+        buffer<char>& out,
+        probe::span_t compiler,
+        bool clang,
+        probe::span_t stdlib
+    ) {
+        const uint64_t k = probe::key("modules-manifest", compiler, stdlib);
+        buffer<char> value;
+        if (not probe::lookup(k, value)) {
+            buffer<char> compiler_path; compiler_path << compiler;
+            probe::unquote(compiler_path);
+            buffer<char> stdlib_arg;
+            char* argv[4] = { compiler_path.data() };
+            char** argp = argv + 1;
+            if (clang and stdlib.size()) {
+                stdlib_arg << stdlib;
+                *argp++ = stdlib_arg.data();
+            }
+            *argp = const_cast<char*>(clang
+                ? "-print-library-module-manifest-path"
+                : "-print-file-name=libstdc++.modules.json");
+            if (shell::capture_argv(value, argv)) return false;
+            while (value.size() and isspace(value.back())) value.pop_back();
+            probe::store(k, value);
+        }
+        // gcc prints the name itself when it has no such file
+        if (not path::absolute(value.data()) or not path::exists(value.data()))
+            return false;
+        out << value.data();
+        return true;
+    }
+
+    // Read the modules of the manifest at path into out, resolving their paths
+    // against its directory.  Returns false if it cannot be read.
+    bool load_manifest(buffer<std_module>& out, const char* path) {
+        using namespace ::cxe::scan;
+        buffer<char> text;
+        if (not file::load(path, text)) return false;
+
+        const char* const slash = strrchr(path, '/');
+        const token_t dir { path, slash ? size_t(slash - path) : size_t(0) };
+        auto resolve = [&](buffer<char>& dst, const buffer<char>& p) {
+            if (dir.size() and not path::absolute(p.data())) dst << dir << "/";
+            dst << p.data();
+        };
+        auto is = [](const buffer<char>& key, const char* name) {
+            return 0 == strcmp(key.data(), name);
+        };
+
+        // walk the JSON, keeping the last key seen at each depth: the
+        // modules are the objects of the "modules" array, at depth 3
+        buffer<char> keys[8];
+        size_t depth = 0;
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+        while (itr < end) {
+            const char c = *itr++;
+            if (c == '{' or c == '[') {
+                if (++depth == 8) return false;
+                keys[depth].clear();
+                if (depth == 3 and is(keys[1], "modules")) out.emplace_back();
+                continue;
+            }
+            if (c == '}' or c == ']') {
+                if (depth) --depth;
+                continue;
+            }
+            if (c != '"') continue;
+
+            buffer<char> str;
+            while (itr < end and *itr != '"') {
+                if (*itr == '\\' and itr + 1 < end) ++itr;
+                str.push_back(*itr++);
+            }
+            ++itr;
+            skip_while(isspace, itr, end);
+            if (prefix(':', itr, end)) {
+                keys[depth].clear();
+                keys[depth] << str.data();
+                continue;
+            }
+
+            if (out.empty() or depth < 3 or not is(keys[1], "modules")) continue;
+            std_module& m = out.back();
+            if (depth == 3 and is(keys[3], "logical-name")) m.name << str.data();
+            if (depth == 3 and is(keys[3], "source-path")) resolve(m.source, str);
+            if (depth == 5 and is(keys[3], "local-arguments")
+                and is(keys[4], "system-include-directories"))
+                resolve(m.includes.emplace_back(), str);
+        }
+        return true;
+    }
+
+} // namespace cxe::modules
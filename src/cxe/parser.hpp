@@ -1,9 +1,26 @@
 #pragma once
+#include <algorithm>
 #include "verify.hpp"
 #include "command.hpp"
 #include "context.hpp"
+#include "debug.hpp"
+#include "devshared.hpp"
+#include "hash.hpp"
+#include "linker.hpp"
+#include "march.hpp"
+#include "modules.hpp"
+#include "path.hpp"
+#include "pch.hpp"
+#include "pgo.hpp"
+#include "postlink.hpp"
 #include "print.hpp"
+#include "probe.hpp"
+#include "schedule.hpp"
 #include "shell.hpp"
+#include "stdpch.hpp"
+#include "thinlto.hpp"
+#include "tier.hpp"
+#include "tune.hpp"
 #include "usage.hpp"
 
 namespace cxe {
@@ -16,6 +33,8 @@ namespace cxe {
     bool is_cpp_path(const token_t& t) {
         using namespace scan;
         return suffix(".cpp", t, ignore_case)
+            or suffix(".cppm", t, ignore_case)
+            or suffix(".ixx", t, ignore_case)
             or suffix(".cxx", t, ignore_case)
             or suffix(".c++", t, ignore_case)
             or suffix(".cc",  t, ignore_case);
@@ -30,6 +49,20 @@ namespace cxe {
         return is_c_path(t) or is_cpp_path(t);
     }
 
+    // file name of a source path, less its extension
+    token_t source_stem(token_t t) {
+        using namespace scan;
+        while (seek("/", t) and skip("/", t));
+        chop(".cpp", t, ignore_case) or
+        chop(".cppm", t, ignore_case) or
+        chop(".ixx", t, ignore_case) or
+        chop(".cxx", t, ignore_case) or
+        chop(".c++", t, ignore_case) or
+        chop(".cc",  t, ignore_case) or
+        chop(".c",   t, ignore_case);
+        return t;
+    }
+
     //--------------------------------------------------------------------------
 
     class parser {
@@ -38,53 +71,179 @@ namespace cxe {
         const tokens_t _src_toks;
 
         commands _pre_compile;
+        commands _variants; // -march-variants= builds, see march.hpp
+        commands _profile;  // -pgo instrument, train & merge, see pgo.hpp
+        commands _train;    // -train { args }, for -pgo and -post-link-opt
+        commands _optimize; // -post-link-opt, see postlink.hpp
+        commands _tune_sets;     // -tune { flags }, see tune.hpp
+        command  _tune_compilers;
+        tune::plan _tune_plan;   // with --tune
+        buffer<char> _tuned;     // -tuned <file>
+        buffer<buffer<char>> _march_levels; // -march-variants=
+        buffer<char> _march_level;          // --march-variant <level>
+        buffer<char> _profdata;
+        command  _pch;     // precompiled include prologue, with -pch
+        commands _objects; // per-source compiles, when _compile links
+        buffer<char> _main_source;       // as appended to _compile
+        command* _main_object = nullptr; // compile of the main source
+        buffer<modules::unit> _units;    // of _objects, see modules.hpp
+        buffer<buffer<char>> _batches;   // sources of -unity batches
+        buffer<buffer<char>> _unity_exclude;
         command  _compile;
         commands _post_compile;
         command  _execute_cmd;
         command  _execute_args;
         bool     _should_execute;
+        bool     _use_pch;
+        bool     _use_std_pch;
+        bool     _unity;
+        bool     _debug;
+        bool     _dwp;
+        bool     _pgo;
+        bool     _post_link_opt;
+        bool     _tiered;          // -tiered
+        bool     _fast_tier;       // the fast tier of -tiered
+        bool     _tier_background; // --tier-background
+        bool     _tuning;        // --tune
+        size_t   _tune_variant;  // --tune-variant <n>, one-based
+        size_t   _jobs;
+        buffer<char> _store; // see store_dir()
 
         parser(const context& ctx)
         : ctx(ctx)
         , _cli_toks(tokenize_cli_text(ctx.cli_text))
         , _src_toks(tokenize_src_text(ctx.src_text))
         , _pre_compile()
+        , _variants()
+        , _profile()
+        , _train()
+        , _optimize()
+        , _tune_sets()
+        , _tune_compilers()
+        , _tune_plan()
+        , _tuned()
+        , _march_levels()
+        , _march_level()
+        , _profdata()
+        , _pch()
+        , _objects()
         , _compile()
         , _post_compile()
         , _execute_cmd()
         , _execute_args()
-        , _should_execute() { }
+        , _should_execute()
+        , _use_pch()
+        , _use_std_pch()
+        , _unity()
+        , _debug()
+        , _dwp()
+        , _pgo()
+        , _post_link_opt()
+        , _tiered()
+        , _fast_tier()
+        , _tier_background()
+        , _tuning()
+        , _tune_variant()
+        , _jobs()
+        , _store() { }
 
     public:
 
-        static buffer<command> parse(const context& ctx) {
+        // parse the commands to run; jobs receives the -j limit, or zero
+        static buffer<command> parse(const context& ctx, size_t& jobs) {
             cxe::parser parser(ctx); parser.parse();
+            jobs = parser._jobs;
+            const bool tiered = parser._tiered and parser._should_execute;
+            const buffer<char> dir = tiered or parser._tier_background ?
+                parser.side_dir("tier") : buffer<char>();
+            buffer<command> cmds = collect(parser);
+
+            // with -tiered, run the fast tier while the build is not
+            // current, and make it current in the background, see tier.hpp
+            if (tiered) {
+                if (not tier::ready(dir, cmds)) {
+                    cxe::parser fast(ctx);
+                    fast._fast_tier = true;
+                    fast.parse();
+                    println("tiered: running the fast tier, see ",dir.data(),"/background.log");
+                    return collect(fast);
+                }
+            }
+
+            if (parser._tier_background) tier::detach(dir);
+            return cmds;
+        }
+
+        // parse the variants to build and time with --tune, see tune.hpp
+        static tune::plan plan(const context& ctx, size_t& jobs) {
+            cxe::parser parser(ctx); parser.parse();
+            jobs = parser._jobs;
+            return std::move(parser._tune_plan);
+        }
+
+    private:
+
+        // the commands of parser, in the order they run
+        static buffer<command> collect(cxe::parser& parser) {
             cxe::buffer<command> cmds;
             cmds.reserve(
                 parser._pre_compile.size() +
+                parser._variants.size() +
+                parser._profile.size() +
+                bool(parser._pch) +
+                parser._objects.size() +
                 1 + // parser._compile
+                parser._optimize.size() +
                 parser._post_compile.size() +
                 parser._should_execute);
 
             for (command* cmd : parser._pre_compile) {
+                cmd->kind(command::pre_compile);
+                cmds.emplace_back(std::move(*cmd));
+            }
+
+            for (command* cmd : parser._variants) {
+                cmd->kind(command::variant);
                 cmds.emplace_back(std::move(*cmd));
             }
 
+            for (command* cmd : parser._profile) {
+                cmd->kind(command::profile);
+                cmds.emplace_back(std::move(*cmd));
+            }
+
+            if (parser._pch) {
+                parser._pch.kind(command::pch);
+                cmds.emplace_back(std::move(parser._pch));
+            }
+
+            for (command* cmd : parser._objects) {
+                cmd->kind(command::compile);
+                cmds.emplace_back(std::move(*cmd));
+            }
+
+            parser._compile.kind(
+                parser._objects ? command::link : command::compile);
             cmds.emplace_back(std::move(parser._compile));
 
+            for (command* cmd : parser._optimize) {
+                cmd->kind(command::optimize);
+                cmds.emplace_back(std::move(*cmd));
+            }
+
             for (command* cmd : parser._post_compile) {
+                cmd->kind(command::post_compile);
                 cmds.emplace_back(std::move(*cmd));
             }
             
             if (parser._should_execute) {
+                parser._execute_cmd.kind(command::execute);
                 cmds.emplace_back(std::move(parser._execute_cmd));
             }
 
             return cmds;
         }
 
-    private:
-
         using span_t = context::span_t;
 
         static tokens_t tokenize_cli_text(span_t text) {
@@ -198,11 +357,83 @@ namespace cxe {
             const char* src_end = src_itr + ctx.src_path.size();
             while (seek("/",src_itr,src_end) and skip("/",src_itr,src_end));
 
-            resolve_and_append_arg(token_t(src_itr, src_end), _compile);
+            _main_source << resolve_and_append_arg(token_t(src_itr, src_end), _compile);
+
+            if (_tuning) return plan_tune();
+            if (_tune_variant) apply_tune_variant();
+            else if (_tuned.size()) append_tuned();
+
+            if (_fast_tier) apply_fast_tier();
+            if (_tier_background) _should_execute = false;
+
+            if (_march_level.size()) apply_march_variant();
+            else if (_march_levels.size()) {
+                // the output is the launcher of the variants
+                append_march_variants();
+                return append_execute();
+            }
+
+            append_dev_shared();
+
+            if (_pgo) append_pgo();
+
+            // a compile may only use one precompiled header, and that of the
+            // prologue of the source covers what it uses of the pool
+            const char* const header =
+                _use_pch     ? append_pch()     :
+                _use_std_pch ? append_std_pch() : nullptr;
+
+            const bool split_debug = _debug and debug::supported(ctx);
+            if (split_debug) debug::insert_args(ctx, _compile, first_source(_compile), _dwp);
+
+            const bool fanned_out = fan_out();
+            if (fanned_out) {
+                // the prologue only serves the main source, the pool serves
+                // every source compiled with the same flags
+                if (header and _use_pch) {
+                    verify(_main_object);
+                    include_pch(*_main_object, header);
+                } else if (header) {
+                    for (command* cmd : _objects) include_pch(*cmd, header);
+                }
+            } else {
+                if (header) include_pch(_compile, header);
+                append_depfile_args(_compile);
+            }
+
+            if (fanned_out or not is_single_step())
+                linker::append_arg(ctx, _compile);
+
+            if (split_debug and fanned_out) append_debug_link();
 
+            // rebuild as the profile changes
+            if (_profdata.size()) {
+                if (not fanned_out) _compile.input(_profdata);
+                for (command* cmd : _objects) cmd->input(_profdata);
+            }
+
+            if (_post_link_opt and (fanned_out or not is_single_step()))
+                append_post_link_opt(fanned_out);
+
+            // a single module has nothing to reuse across links
+            if (fanned_out and ctx.compiler_is_clang and thinlto::enabled(_compile)) {
+                const size_t jobs = _jobs ? _jobs : schedule::default_jobs();
+                thinlto::append_args(_compile, store_dir(), jobs);
+            }
+
+            append_execute();
+        }
+
+        // complete the command which runs the output, with -- <args>
+        void append_execute() {
             if (_should_execute) {
                 if (_execute_cmd.empty()) {
-                    _execute_cmd.append(token_t("a"));
+                    // the compiler's default output
+                    #if defined(_WIN32)
+                        _execute_cmd.append(token_t("a"));
+                    #else
+                        _execute_cmd.append(token_t("./a.out"));
+                    #endif
                 }
                 for (const char* arg : _execute_args) {
                     _execute_cmd.append(token_t(arg, strlen(arg)));
@@ -217,7 +448,7 @@ namespace cxe {
             const token_t t = itr.read();
             verify(t.size());
 
-            if (const bool is_compile_cmd = &cmd == &_compile) {
+            if (&cmd == &_compile) {
                 if (equals("-help",t) or equals("--help",t))
                     return puts(USAGE), exit(1);
 
@@ -230,13 +461,163 @@ namespace cxe {
                     return;
                 }
 
+                // handled by main(), once the build has finished
+                if (equals("--link-bench",t))
+                    return;
+
+                if (equals("-tiered",t)) {
+                    _tiered = true;
+                    return;
+                }
+
+                // the build of -tiered, made current by a detached cxe
+                if (equals("--tier-background",t)) {
+                    _tier_background = true;
+                    return;
+                }
+
+                if (equals("--tune",t)) {
+                    _tuning = true;
+                    return;
+                }
+
+                // a variant of --tune, built by a nested cxe
+                if (equals("--tune-compiler",t)) {
+                    // handled by main(), which picks the compiler
+                    if (not itr) error(1,at(t),"expected compiler path");
+                    itr.advance();
+                    return;
+                }
+
+                if (equals("--tune-variant",t)) {
+                    const token_t n = itr.read();
+                    _tune_variant = 0;
+                    for (const char c : n) {
+                        if (not isdigit(c)) { _tune_variant = 0; break; }
+                        _tune_variant = _tune_variant * 10 + size_t(c - '0');
+                    }
+                    if (not _tune_variant)
+                        error(1,at(n.size() ? n : t),"expected variant number");
+                    return;
+                }
+
+                if (equals("-tune",t)) {
+                    parse_block(itr, _tune_sets.append());
+                    return;
+                }
+
+                if (equals("-tune-compilers",t)) {
+                    parse_block(itr, _tune_compilers);
+                    return;
+                }
+
+                if (token_t levels = t; skip("-march-variants=",levels)) {
+                    _march_levels.clear();
+                    while (levels.size()) {
+                        token_t level = levels;
+                        if (seek(",",level)) {
+                            level = token_t(levels.data(), level.data());
+                            levels = token_t(level.data() + level.size() + 1,
+                                levels.data() + levels.size());
+                        } else {
+                            levels = token_t(levels.data() + levels.size(), size_t(0));
+                        }
+                        if (level.size()) _march_levels.emplace_back() << level;
+                    }
+                    if (_march_levels.empty()) error(1,at(t),"expected -march levels");
+                    return;
+                }
+
+                // a variant of -march-variants=, built by a nested cxe
+                if (equals("--march-variant",t)) {
+                    const token_t level = itr.read();
+                    if (not level.size()) error(1,at(t),"expected -march level");
+                    _march_level.clear();
+                    _march_level << level;
+                    return;
+                }
+
+                if (equals("-tuned",t)) {
+                    if (not itr) error(1,at(t),"expected file path");
+                    _tuned.clear();
+                    _tuned << resolve_arg(itr.read());
+                    return;
+                }
+
+                // -g, so that "-if (-g)" holds, see debug.hpp
+                if (equals("-debug",t)) {
+                    _debug = true;
+                    cmd.append(token_t("-g", 2));
+                    return;
+                }
+
+                // reaches nested cxe processes, see devshared.hpp
+                if (equals("-dev-shared",t)) {
+                    devshared::enable();
+                    return;
+                }
+
+                if (equals("-dwp",t)) {
+                    _dwp = true;
+                    return;
+                }
+
+                if (equals("-pgo",t)) {
+                    _pgo = true;
+                    return;
+                }
+
+                if (equals("-train",t)) {
+                    parse_block(itr, _train.append());
+                    return;
+                }
+
+                if (equals("-post-link-opt",t)) {
+                    _post_link_opt = true;
+                    return;
+                }
+
+                if (equals("-pch",t)) {
+                    _use_pch = true;
+                    return;
+                }
+
+                if (equals("-std-pch",t)) {
+                    _use_std_pch = true;
+                    return;
+                }
+
+                if (equals("-unity",t)) {
+                    _unity = true;
+                    return;
+                }
+
+                if (equals("-unity-exclude",t)) {
+                    if (not itr) error(1,at(t),"expected source path");
+                    _unity_exclude.emplace_back() << resolve_arg(itr.read());
+                    return;
+                }
+
                 if (equals("-pre",t)) {
-                    parse_block(itr, _pre_compile.append());
+                    parse_job(itr, _pre_compile.append());
                     return;
                 }
 
                 if (equals("-post",t)) {
-                    parse_block(itr, _post_compile.append());
+                    parse_job(itr, _post_compile.append());
+                    return;
+                }
+
+                if (token_t j = t; skip("-j",j)) {
+                    // -j <jobs> or -j<jobs>
+                    const token_t n = j.size() ? j : itr.read();
+                    _jobs = 0;
+                    for (const char c : n) {
+                        if (not isdigit(c)) { _jobs = 0; break; }
+                        _jobs = _jobs * 10 + size_t(c - '0');
+                    }
+                    if (not _jobs)
+                        error(1,at(n.size() ? n : t),"expected number of jobs");
                     return;
                 }
 
@@ -300,6 +681,43 @@ namespace cxe {
             cond ? parse_block(itr, cmd) : skip_block(itr);
         }
 
+        // parse [name] [after(name...)] { ... }
+        void parse_job(tokitr& itr, command& cmd) {
+            using namespace ::cxe::scan;
+
+            token_t a = itr.peek();
+            if (a.size() and not equals("{",a) and not equals("after",a)) {
+                cmd.name(a);
+                itr.advance();
+                a = itr.peek();
+            }
+
+            if (equals("after",a)) {
+                itr.advance();
+                const token_t b = itr.read();
+                if (not equals("(",b)) error(1,at(b),"expected \"(\"");
+                for (;;) {
+                    if (not itr) error(1,at(itr.peek()),"expected \")\"");
+                    const token_t c = itr.read();
+                    if (equals(")",c)) break;
+                    cmd.after(c);
+                }
+            }
+
+            parse_block(itr, cmd);
+
+            if (cmd.name()[0]) return;
+
+            // by default, a job is named for the stem of its first source,
+            // so that "-pre { $CXE dep.c }" may be referred to as "dep"
+            for (const char* arg : cmd) {
+                const token_t t { arg, strlen(arg) };
+                if (not is_c_cpp_path(t)) continue;
+                cmd.name(source_stem(t));
+                return;
+            }
+        }
+
         // parse tokens within { ... }
         void parse_block(tokitr& itr, command& cmd) {
             using namespace ::cxe::scan;
@@ -429,11 +847,10 @@ namespace cxe {
             // resolve implicit --target to effective triple
             if (prefix("--target", src)) {
                 buffer<char> buf; buf << "--target=";
-                buffer<char> cc;
-                cc << ctx.compiler_path << " -print-effective-triple";
-                if (const int status = shell::run(buf, cc)) {
+                if (const int status = probe::triple(buf, ctx.compiler_path)) {
                     error(1,at(src),"failed to resolve --target: ",
-                        cc.data()," returned ",status);
+                        ctx.compiler_path," -print-effective-triple returned ",
+                        status);
                 }
                 return cmd.append(buf);
             }
@@ -441,6 +858,902 @@ namespace cxe {
             return nullptr;
         }
 
+        // request "-MMD -MF <output>.d" so that deps::record() can track the
+        // inputs of the compile, unless dependency output is already
+        // configured, or the compiler does not understand these options
+        void append_depfile_args(command& cmd) {
+            using namespace ::cxe::scan;
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc)) return;
+            if (not cmd.output()[0]) return;
+            if (cmd.find(prefix, token_t("-M", 2))) return;
+
+            buffer<char> dep_path; dep_path << cmd.output() << ".d";
+            cmd.append(token_t("-MMD"));
+            cmd.append(token_t("-MF"));
+            cmd.append(dep_path);
+        }
+
+        // With -pgo, compile with the profile of the program, and if it is not
+        // current, make it first, see pgo.hpp.
+        void append_pgo() {
+            using namespace ::cxe::scan;
+            if (not ctx.compiler_is_clang) error(1,{},"-pgo requires clang");
+            if (is_single_step()) return;
+
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+
+            buffer<pgo::source> sources;
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                if (takes_value(t)) { ++i; continue; }
+                if (is_c_cpp_path(t) and not pgo::scan(sources.emplace_back(), argv[i]))
+                    error(1,{},"file not found: ", argv[i]);
+            }
+
+            const buffer<char> dir = side_dir("pgo");
+            _profdata = pgo::profile_path(dir);
+            if (not pgo::current(dir, sources)) {
+                command& build = _profile.append();
+                append_args_less_output(build);
+                if (not pgo::append_steps(ctx, _profile, build, dir, output_name(), train_args()))
+                    error(1,{},"-pgo: llvm-profdata not found");
+            }
+
+            // ahead of the sources, which fan_out() finds the main one among
+            pgo::insert_use_args(_compile, first_source(_compile), _profdata);
+        }
+
+        // the arguments of _compile, less its output, appended to cmd
+        void append_args_less_output(command& cmd) {
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+            for (size_t i = 0; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                const size_t n = takes_value(t) and i + 1 < argc ? 2 : 1;
+                if (not is_output_arg(t)) {
+                    for (size_t k = i; k < i + n; ++k)
+                        cmd.append(token_t(argv[k], strlen(argv[k])));
+                }
+                i += n - 1;
+            }
+        }
+
+        // the argument sets of the training runs of -pgo and -post-link-opt:
+        // each -train { args }, or else the arguments after --
+        commands& train_args() {
+            if (not _train) {
+                command& args = _train.append();
+                for (const char* arg : _execute_args)
+                    args.append(token_t(arg, strlen(arg)));
+            }
+            return _train;
+        }
+
+        // <output dir>/.cxe/<source name>-<suffix>, created if need be
+        buffer<char> side_dir(const char* suffix) {
+            const char* const output = output_path();
+            buffer<char> dir;
+            dir << token_t(output, output_name().data());
+            dir << ".cxe/" << ctx.src_name << "-" << suffix;
+            if (not path::make_dirs(dir.data()))
+                error(1,{},"failed to create directory: ",dir.data());
+            return dir;
+        }
+
+        // point the -o of _compile, or its default output, at path
+        void redirect_output(const buffer<char>& path) {
+            using namespace ::cxe::scan;
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                if (equals("-o", t) or equals("--output", t)) {
+                    if (i + 1 < argc) _compile.replace(i + 1, path);
+                    _compile.output(path);
+                    return;
+                }
+                if (is_output_arg(t)) {
+                    buffer<char> arg; arg << "-o" << path.data();
+                    _compile.replace(i, arg);
+                    _compile.output(path);
+                    return;
+                }
+            }
+            _compile.append(token_t("-o", 2));
+            _compile.append(path);
+            _compile.output(path);
+        }
+
+        // <output dir>/.cxe/<source name>-tune/<n>/<output name>, the
+        // program of variant n of --tune, whose directory is created
+        buffer<char> tune_output(size_t n) {
+            buffer<char> path; print_to(path, side_dir("tune").data(), "/", n);
+            if (not path::make_dirs(path.data()))
+                error(1,{},"failed to create directory: ",path.data());
+            path << "/" << output_name();
+            return path;
+        }
+
+        // With --tune, plan a nested cxe build of each compiler and flag
+        // set, and a run of each, see tune.hpp.
+        void plan_tune() {
+            using namespace ::cxe::scan;
+            if (_tuned.size()) _tune_plan.tuned << _tuned.data();
+
+            buffer<buffer<char>> compilers;
+            for (const char* name : _tune_compilers) {
+                if (tune::find_compiler(compilers.emplace_back(), token_t(name, strlen(name))))
+                    error(1,{},"-tune-compilers: compiler not found: ",name);
+            }
+            if (compilers.empty()) compilers.emplace_back() << ctx.compiler_path;
+
+            size_t n = 0;
+            for (const buffer<char>& compiler : compilers) {
+                token_t compiler_name { compiler.data(), compiler.size() };
+                while (seek("/", compiler_name) and skip("/", compiler_name));
+
+                for (command* set : _tune_sets) {
+                    buffer<char> number; print_to(number, ++n);
+                    const buffer<char> output = tune_output(n);
+
+                    command& build = _tune_plan.builds.emplace_back();
+                    buffer<char> name; print_to(name, "tune-", n);
+                    build.name(name);
+                    append_cli_args(build);
+                    build.append(token_t("--tune-compiler"));
+                    build.append(compiler);
+                    build.append(token_t("--tune-variant"));
+                    build.append(number);
+                    build.output(output);
+
+                    tune::variant& v = _tune_plan.variants.emplace_back();
+                    v.compiler << compiler.data();
+                    for (const char* arg : *set) {
+                        if (v.flags.size()) v.flags << " ";
+                        v.flags << arg;
+                    }
+                    v.label << compiler_name;
+                    if (v.flags.size()) v.label << " " << v.flags.data();
+                    v.run.append(output);
+                    for (const char* arg : _execute_args)
+                        v.run.append(token_t(arg, strlen(arg)));
+                }
+            }
+        }
+
+        // With --tune-variant <n>, build variant n of --tune: append its
+        // flag set and redirect the output to tune_output(n).
+        void apply_tune_variant() {
+            const size_t sets = _tune_sets.size();
+            if (not sets) error(1,{},"--tune-variant: no -tune { <flags> } in the cxe block");
+            command& set = *_tune_sets.begin()[(_tune_variant - 1) % sets];
+            for (const char* arg : set) _compile.append(token_t(arg, strlen(arg)));
+
+            redirect_output(tune_output(_tune_variant));
+            _should_execute = false;
+        }
+
+        // The arguments of this cxe for a nested cxe building a variant of
+        // the program, less those of --tune, --link-bench and after --.
+        void append_cli_args(command& cmd) {
+            using namespace ::cxe::scan;
+            cmd.append(ctx.cxe_path);
+            cmd.append(ctx.src_path);
+            if (tokitr itr = _cli_toks) {
+                itr.advance(); // skip cxe name
+                itr.advance(); // skip src path
+                while (itr) {
+                    const token_t t = itr.read();
+                    if (equals("--",t)) break;
+                    if (equals("--tune",t) or equals("--link-bench",t)) continue;
+                    cmd.append(t);
+                }
+            }
+        }
+
+        // With -march-variants=, build the program once per level with a
+        // nested cxe, to <output>.<level>, and compile the launcher of the
+        // variants to the output, see march.hpp.
+        void append_march_variants() {
+            #if defined(_WIN32)
+                error(1,{},"-march-variants= requires a POSIX target");
+            #endif
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc))
+                error(1,{},"-march-variants= requires clang or gcc");
+
+            buffer<char> output; output << output_path();
+            buffer<buffer<char>> features;
+            for (const buffer<char>& level : _march_levels) {
+                if (march::features(features.emplace_back(), ctx.compiler_path, level.data()))
+                    error(1,{},"-march-variants=: ",ctx.compiler_path," rejects -march=",level.data());
+
+                command& build = _variants.append();
+                append_cli_args(build);
+                march::append_variant_args(build, output.data(), level);
+            }
+
+            buffer<char> launcher; launcher << side_dir("march").data() << "/launcher.c";
+            if (not march::write_launcher(launcher.data(), _march_levels, features))
+                error(1,{},"failed to write launcher: ",launcher.data());
+
+            _compile = command();
+            resolve_and_append_arg(ctx.compiler_path, _compile);
+            march::append_launcher_args(_compile, launcher.data(), output);
+            append_depfile_args(_compile);
+        }
+
+        // With --march-variant <level>, build the program for level to
+        // <output>.<level>, leaving -pre and -post to the launcher's cxe.
+        void apply_march_variant() {
+            march::append_level_args(_compile, _march_level);
+            redirect_output(march::variant_path(output_path(), _march_level));
+            _pre_compile = commands();
+            _post_compile = commands();
+            _should_execute = false;
+        }
+
+        // Build the fast tier of -tiered, see tier.hpp: at -O0, without LTO
+        // or the stages which only serve speed, to <output dir>/.cxe/<source
+        // name>-tier/<output name>, and run it, once a detached cxe has
+        // started to make the build current, unless one is running.
+        void apply_fast_tier() {
+            tier::append_fast_args(_compile);
+            _pgo = _post_link_opt = false;
+            _march_levels.clear();
+
+            const buffer<char> dir = side_dir("tier");
+            const buffer<char> fast = tier::fast_path(dir, output_name());
+            redirect_output(fast);
+            _execute_cmd = command();
+            resolve_execute_cmd(token_t(fast.data(), fast.size()));
+
+            if (tier::building(dir)) return;
+            command& background = _post_compile.append();
+            append_cli_args(background);
+            tier::append_background_args(background);
+        }
+
+        // With -dev-shared, build an archive as the shared library which
+        // stands in for it, and link programs with an rpath to their -L
+        // directories.  Without, remove the shared library, see devshared.hpp.
+        void append_dev_shared() {
+            using namespace ::cxe::scan;
+            const buffer<char> library = devshared::library(output_path());
+            const bool archive = library.size() and _compile.find(equals, token_t("-c", 2));
+
+            if (not devshared::enabled()) {
+                if (archive and path::exists(library.data())) {
+                    path::remove(library.data());
+                    path::remove(deps::log_path(library.data()).data());
+                }
+                return;
+            }
+
+            if (not archive) {
+                // ahead of the sources, which fan_out() finds the main one among
+                if (not is_single_step())
+                    devshared::insert_rpaths(_compile, first_source(_compile));
+                return;
+            }
+
+            char** const argv = _compile.argv();
+            for (size_t i = 1; i < _compile.argc(); ++i) {
+                if (0 == strcmp(argv[i], "-c")) _compile.replace(i, token_t("-shared", 7));
+            }
+            size_t at = first_source(_compile);
+            _compile.insert(at++, token_t("-fPIC", 5));
+            #if defined(__APPLE__)
+                token_t name { library.data(), library.size() };
+                while (seek("/", name) and skip("/", name));
+                buffer<char> install_name; install_name << "-Wl,-install_name,@rpath/" << name;
+                _compile.insert(at++, install_name);
+            #endif
+            redirect_output(library);
+        }
+
+        // With -tuned <file>, append the flags written to it by --tune.
+        void append_tuned() {
+            buffer<char> text;
+            if (not file::load(_tuned.data(), text)) return;
+            tokens_t toks;
+            tokenize(toks, token_t(text.data(), text.size()));
+            for (const token_t& t : toks) _compile.append(t);
+        }
+
+        // -post-link-opt, see postlink.hpp
+        void append_post_link_opt(bool fanned_out) {
+            using namespace ::cxe::scan;
+            #if defined(_WIN32) || defined(__APPLE__)
+                error(1,{},"-post-link-opt requires an ELF target");
+            #endif
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc))
+                error(1,{},"-post-link-opt requires clang or gcc");
+
+            const buffer<char> dir = side_dir("postlink");
+            const char* const output = output_path();
+
+            buffer<char> bolt;
+            if (0 == probe::tool(bolt, ctx.compiler_path, "llvm-bolt")) {
+                postlink::append_steps(_optimize, bolt, dir, output, train_args());
+                redirect_output(postlink::linked_path(dir));
+                postlink::append_link_args(_compile);
+                return;
+            }
+
+            // without llvm-bolt, order the functions by the -pgo profile
+            const char* const lld = _compile.find(equals, token_t("-fuse-ld=lld", 12));
+            const char* const mold = _compile.find(equals, token_t("-fuse-ld=mold", 13));
+            if (_profdata.empty() or not (lld or mold))
+                error(1,{},"-post-link-opt requires llvm-bolt, or -pgo and lld or mold");
+
+            postlink::append_order_args(_compile, dir, lld);
+            if (fanned_out) _compile.input(_profdata);
+        }
+
+        // the link of a -debug build, see debug.hpp
+        void append_debug_link() {
+            debug::append_link_args(_compile);
+            debug::prune(store_dir(), _objects);
+
+            buffer<char> dwp; dwp << output_path() << ".dwp";
+            if (not _dwp) {
+                // a package of an earlier link would mislead the debugger
+                path::remove(dwp.data());
+                return;
+            }
+            if (not debug::append_dwp(ctx, _post_compile.append(), output_path()))
+                error(1,{},"-dwp: ", ctx.compiler_is_clang ? "llvm-dwp" : "dwp", " not found");
+        }
+
+        //----------------------------------------------------------------------
+
+        // options whose value is the next argument
+        static bool takes_value(const token_t& t) {
+            using namespace ::cxe::scan;
+            static const char* const options[] = {
+                "-o", "--output", "-MF", "-MT", "-MQ", "-D", "-U", "-I",
+                "-include", "-imacros", "-isystem", "-iquote", "-idirafter",
+                "-L", "-l", "-Xlinker", "-framework",
+            };
+            for (const char* option : options)
+                if (equals(option, t)) return true;
+            return false;
+        }
+
+        // index of the first source of cmd, or else its end, where options
+        // go which must not follow the sources
+        static size_t first_source(command& cmd) {
+            char** const argv = cmd.argv();
+            const size_t argc = cmd.argc();
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                if (takes_value(t)) { ++i; continue; }
+                if (is_c_cpp_path(t)) return i;
+            }
+            return argc;
+        }
+
+        // options which make the command something other than compile & link
+        static bool is_single_step_arg(const token_t& t) {
+            using namespace ::cxe::scan;
+            return equals("-c", t) or equals("-S", t) or equals("-E", t)
+                or equals("-M", t) or equals("-MM", t) or prefix("-x", t)
+                or equals("-fsyntax-only", t) or equals("-emit-llvm", t)
+                or equals("-###", t);
+        }
+
+        static bool is_output_arg(const token_t& t) {
+            using namespace ::cxe::scan;
+            return prefix("-o", t) or prefix("--output", t);
+        }
+
+        static bool is_depfile_arg(const token_t& t) {
+            using namespace ::cxe::scan;
+            return equals("-MD", t) or equals("-MMD", t) or equals("-MP", t)
+                or equals("-MF", t) or equals("-MT", t) or equals("-MQ", t);
+        }
+
+        // arguments used only when linking, including objects and libraries
+        static bool is_link_arg(const token_t& t) {
+            using namespace ::cxe::scan;
+            return prefix("-l", t) or prefix("-L", t) or prefix("-Wl,", t)
+                or equals("-Xlinker", t) or equals("-framework", t)
+                or prefix("-fuse-ld=", t) or equals("-shared", t)
+                or equals("-static", t) or equals("-rdynamic", t)
+                or equals("-pie", t) or equals("-no-pie", t)
+                or equals("-nostdlib", t) or equals("-nostartfiles", t)
+                or suffix(".o", t) or suffix(".obj", t, ignore_case)
+                or suffix(".a", t) or suffix(".lib", t, ignore_case)
+                or suffix(".so", t) or suffix(".dylib", t)
+                or suffix(".tbd", t);
+        }
+
+        // arguments used only when compiling
+        static bool is_compile_arg(const token_t& t) {
+            using namespace ::cxe::scan;
+            return prefix("-D", t) or prefix("-U", t) or prefix("-I", t)
+                or equals("-include", t) or equals("-imacros", t)
+                or equals("-isystem", t) or equals("-iquote", t)
+                or equals("-idirafter", t) or prefix("-std=", t)
+                or prefix("-pedantic", t) or prefix("-fprofile-instr-use", t)
+                or (prefix("-W", t) and not prefix("-Wl,", t));
+        }
+
+        // the output of _compile, or the compiler's default
+        const char* output_path() const {
+            if (_compile.output()[0]) return _compile.output();
+            #if defined(_WIN32)
+                return "a.exe";
+            #else
+                return "a.out";
+            #endif
+        }
+
+        // the file name of output_path(), less its directory
+        token_t output_name() const {
+            using namespace ::cxe::scan;
+            const char* const output = output_path();
+            token_t name { output, strlen(output) };
+            while (seek("/", name) and skip("/", name));
+            return name;
+        }
+
+        // Directory of the objects and precompiled header built for _compile,
+        // <output dir>/.cxe/<source name>-<flags hash>/, where the hash
+        // covers the compiler and the arguments of every per-source compile.
+        const buffer<char>& store_dir() {
+            using namespace ::cxe::scan;
+            if (_store.size()) return _store;
+
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+
+            cxe::hash h;
+            for (size_t i = 0; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                const size_t n = takes_value(t) and i + 1 < argc ? 2 : 1;
+                if (i == 0 or is_object_arg(t, n)) {
+                    for (size_t k = i; k < i + n; ++k) h.update(argv[k]);
+                }
+                i += n - 1;
+            }
+            char flags_hash[17]; hash::format(flags_hash, h.digest());
+            flags_hash[8] = 0;
+
+            const char* const output = output_path();
+            _store << token_t(output, output_name().data());
+            _store << ".cxe/" << ctx.src_name << "-" << flags_hash;
+            if (not path::make_dirs(_store.data()))
+                error(1,{},"failed to create directory: ",_store.data());
+            return _store;
+        }
+
+        // whether t, with n - 1 values, belongs in the compile of each object
+        static bool is_object_arg(const token_t& t, size_t n) {
+            return not (is_link_arg(t) or is_output_arg(t) or is_depfile_arg(t)
+                or (n == 1 and is_c_cpp_path(t)));
+        }
+
+        // Split a compile of several translation units into one compile per
+        // source, each to an object of its own, so that they may run
+        // concurrently, and turn _compile into the link of those objects.
+        //
+        // Objects are kept in <output dir>/.cxe/<source name>-<flags hash>/,
+        // so that switching between flag sets (e.g. -O0 and -O2) finds the
+        // objects of each set still in place.  Each object has its own
+        // up-to-date check, and the link has one over the objects, so only
+        // stale objects are rebuilt, and the link is skipped when none were.
+        bool fan_out() {
+            using namespace ::cxe::scan;
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc)) return false;
+
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+
+            size_t sources = 0;
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                if (is_single_step_arg(t)) return false;
+                if (takes_value(t)) { ++i; continue; }
+                if (is_c_cpp_path(t)) ++sources;
+            }
+            // a debug build keeps even a single object, and its .dwo, in
+            // the object store, as does a build importing std, with the std
+            // module beside it
+            if (sources < (_debug ? 1 : 2) and not (sources and imports_std()))
+                return false;
+
+            #if defined(_WIN32)
+                const char* const object_ext = ".obj";
+            #else
+                const char* const object_ext = ".o";
+            #endif
+
+            const char* const output = output_path();
+            const buffer<char>& object_dir = store_dir();
+
+            buffer<int> batch_of;
+            if (_unity) plan_unity(argv, argc, batch_of);
+            buffer<command*> batch_cmds;
+            batch_cmds.resize(_batches.size());
+
+            command link;
+            link.append(token_t(argv[0], strlen(argv[0])));
+
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                const size_t n = takes_value(t) and i + 1 < argc ? 2 : 1;
+
+                if (is_c_cpp_path(t) and n == 1) {
+                    // a -unity batch is compiled once, linked where its
+                    // first member was
+                    const int b = batch_of.size() ? batch_of[i] : -1;
+                    if (b < 0 or not batch_cmds[b]) {
+                        const buffer<char>* const batch = b < 0 ? nullptr : &_batches[b];
+                        const token_t source = batch
+                            ? token_t(batch->data(), batch->size()) : t;
+                        const char* const object = append_object(
+                            object_dir, object_ext, argv, argc, source);
+                        link.append(token_t(object, strlen(object)));
+                        if (b >= 0) batch_cmds[b] = *(_objects.end() - 1);
+                    }
+                    // the main source, wherever flags were added around it
+                    if (equals(_main_source.data(), t))
+                        _main_object = b < 0 ? *(_objects.end() - 1) : batch_cmds[b];
+                    continue;
+                }
+
+                if (not (is_compile_arg(t) or is_depfile_arg(t))) {
+                    for (size_t k = i; k < i + n; ++k)
+                        link.append(token_t(argv[k], strlen(argv[k])));
+                }
+                i += n - 1;
+            }
+
+            append_std_modules(object_dir, object_ext, argv, argc, link);
+
+            link.output(token_t(output, strlen(output)));
+            _compile = std::move(link);
+            append_module_args();
+            return true;
+        }
+
+        // whether a source of _compile imports a module of the standard
+        // library, see modules.hpp
+        bool imports_std() {
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                if (takes_value(t)) { ++i; continue; }
+                if (not is_cpp_path(t)) continue;
+                modules::unit u;
+                if (not modules::scan(u, argv[i])) continue;
+                for (const buffer<char>& import : u.imports)
+                    if (modules::is_std(import)) return true;
+            }
+            return false;
+        }
+
+        // Append the compile of each module of the standard library which a
+        // source imports and none provides, from the source named by the
+        // module manifest of the compiler, and link its object.
+        void append_std_modules(
+            const buffer<char>& object_dir,
+            const char* object_ext,
+            char** argv,
+            size_t argc,
+            command& link
+        ) {
+            using namespace ::cxe::scan;
+            buffer<modules::std_module> manifest;
+            bool loaded = false;
+
+            // _units grows as the std modules, which import each other, are added
+            for (size_t i = 0; i < _units.size(); ++i) {
+                for (size_t j = 0; j < _units[i].imports.size(); ++j) {
+                    buffer<char> import; import << _units[i].imports[j].data();
+                    if (not modules::is_std(import)) continue;
+
+                    bool provided = false;
+                    for (const modules::unit& u : _units)
+                        provided = provided or (u.exports and 0 == strcmp(u.name.data(), import.data()));
+                    if (provided) continue;
+
+                    if (not loaded) {
+                        loaded = true;
+                        const char* const stdlib = _compile.find(prefix, token_t("-stdlib=", 8));
+                        const token_t stdlib_arg = stdlib ? token_t(stdlib, strlen(stdlib)) : token_t();
+                        buffer<char> path;
+                        if (modules::manifest_path(path, ctx.compiler_path, ctx.compiler_is_clang, stdlib_arg))
+                            modules::load_manifest(manifest, path.data());
+                    }
+
+                    // without a manifest, import std is left to the compiler
+                    for (modules::std_module& m : manifest) {
+                        if (0 != strcmp(m.name.data(), import.data())) continue;
+                        m.name.clear(); // built once, even if its scan fails
+                        const token_t source { m.source.data(), m.source.size() };
+                        const char* const object = append_object(
+                            object_dir, object_ext, argv, argc, source);
+                        command& cmd = **(_objects.end() - 1);
+                        for (const buffer<char>& include : m.includes) {
+                            cmd.append(token_t("-isystem", 8));
+                            cmd.append(include);
+                        }
+                        if (ctx.compiler_is_clang)
+                            cmd.append(token_t("-Wno-reserved-module-identifier", 31));
+                        link.append(token_t(object, strlen(object)));
+                        break;
+                    }
+                }
+            }
+        }
+
+        // For -unity, assign each source of _compile to one of up to -j
+        // batches of its language, balancing their line counts, except for
+        // sources opted out with -unity-exclude and module units.  Each
+        // batch is written to <store>/unity-<n>.c or .cpp as #include lines
+        // of its members, and only rewritten when its members change.
+        // batch_of[i] receives the batch of argv[i], or -1.
+        void plan_unity(char** argv, size_t argc, buffer<int>& batch_of) {
+            using namespace ::cxe::scan;
+            struct member { size_t arg; size_t lines; };
+
+            const size_t jobs = _jobs ? _jobs : schedule::default_jobs();
+            batch_of.resize(argc, -1);
+
+            for (const bool cpp : { false, true }) {
+                buffer<member> members;
+                for (size_t i = 1; i < argc; ++i) {
+                    const token_t t { argv[i], strlen(argv[i]) };
+                    if (takes_value(t) and i + 1 < argc) { ++i; continue; }
+                    if (not is_c_cpp_path(t) or is_cpp_path(t) != cpp) continue;
+
+                    bool excluded = false;
+                    for (const buffer<char>& e : _unity_exclude)
+                        excluded = excluded or 0 == strcmp(e.data(), argv[i]);
+                    modules::unit unit;
+                    if (excluded or modules::scan(unit, argv[i])) continue;
+
+                    buffer<char> text;
+                    file::load(argv[i], text);
+                    size_t lines = 1;
+                    for (const char c : text) lines += c == '\n';
+                    members.push_back({ i, lines });
+                }
+                if (members.empty()) continue;
+
+                // longest first, each to the batch with the fewest lines
+                std::sort(members.begin(), members.end(),
+                    [](const member& a, const member& b) { return a.lines > b.lines; });
+                const size_t first = _batches.size();
+                const size_t count = members.size() < jobs ? members.size() : jobs;
+                buffer<size_t> lines;
+                lines.resize(count, 0);
+                for (const member& m : members) {
+                    size_t b = 0;
+                    for (size_t k = 1; k < count; ++k)
+                        if (lines[k] < lines[b]) b = k;
+                    lines[b] += m.lines;
+                    batch_of[m.arg] = int(first + b);
+                }
+
+                for (size_t b = first; b < first + count; ++b) {
+                    buffer<char>& path = _batches.emplace_back();
+                    print_to(path, store_dir().data(), "/unity-", b - first);
+                    path << (cpp ? ".cpp" : ".c");
+
+                    // members in the order they were listed
+                    buffer<char> text;
+                    for (size_t i = 1; i < argc; ++i) {
+                        if (batch_of[i] != int(b)) continue;
+                        buffer<char> member; member << argv[i];
+                        path::qualify(member);
+                        text << "#include \"" << member.data() << "\"\n";
+                    }
+                    if (not pch::write_header(path.data(), text))
+                        error(1,{},"failed to write unity batch: ",path.data());
+                }
+            }
+        }
+
+        // Order the compile of each module interface before the compiles
+        // which import it, and let every compile find the interfaces, if any
+        // source declares or imports a module, see modules.hpp.
+        void append_module_args() {
+            bool any = false;
+            for (const modules::unit& u : _units) any = any or u.name.size() or u.imports.size();
+            if (not any) return;
+
+            const buffer<char>& store = store_dir();
+            const char* const ext = ctx.compiler_is_clang ? ".pcm" : ".gcm";
+
+            buffer<char> map_path; map_path << store.data() << "/modules.map";
+            buffer<char> map;
+
+            for (size_t i = 0; i < _units.size(); ++i) {
+                const modules::unit& u = _units[i];
+                command& cmd = **(_objects.begin() + i);
+
+                if (ctx.compiler_is_clang) {
+                    buffer<char> arg;
+                    arg << "-fprebuilt-module-path=" << store.data();
+                    cmd.append(arg);
+                } else {
+                    cmd.append(token_t("-fmodules-ts"));
+                    buffer<char> arg; arg << "-fmodule-mapper=" << map_path.data();
+                    cmd.append(arg);
+                }
+
+                if (u.exports) {
+                    const buffer<char> bmi = modules::bmi_path(store, u.name, ext);
+                    cmd.name(modules::job_name(u.name));
+                    if (ctx.compiler_is_clang) {
+                        buffer<char> arg; arg << "-fmodule-output=" << bmi.data();
+                        cmd.append(arg);
+                    }
+                    map << u.name.data() << " " << bmi.data() << "\n";
+                }
+
+                for (const buffer<char>& import : u.imports) {
+                    for (const modules::unit& v : _units) {
+                        if (&v == &u or not v.exports) continue;
+                        if (0 != strcmp(v.name.data(), import.data())) continue;
+                        cmd.after(modules::job_name(import));
+                        cmd.input(modules::bmi_path(store, import, ext));
+                    }
+                }
+            }
+
+            if (ctx.compiler_is_gcc and not pch::write_header(map_path.data(), map))
+                error(1,{},"failed to write module map: ",map_path.data());
+        }
+
+        // Precompile the include prologue of the main source, see pch.hpp,
+        // with the arguments of the compile of the main source.  Returns the
+        // path of the generated header, or null if there is no prologue.
+        const char* append_pch() {
+            using namespace ::cxe::scan;
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc)) return nullptr;
+
+            buffer<char> text;
+            if (not file::load(ctx.src_path.data(), text)) return nullptr;
+
+            buffer<char> prologue;
+            if (not pch::prologue(prologue, text)) return nullptr;
+
+            if (is_single_step()) return nullptr;
+
+            char** const argv = _compile.argv();
+            const size_t argc = _compile.argc();
+
+            buffer<char> header; header << store_dir().data() << "/prologue.h";
+            if (not pch::write_header(header.data(), prologue))
+                error(1,{},"failed to write precompiled header: ",header.data());
+
+            // gcc looks for <header>.gch when including <header>
+            buffer<char> output; output << header.data();
+            output << (ctx.compiler_is_clang ? ".pch" : ".gch");
+
+            command& cmd = _pch;
+            cmd.append(token_t(argv[0], strlen(argv[0])));
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                const size_t n = takes_value(t) and i + 1 < argc ? 2 : 1;
+                if (is_object_arg(t, n)) {
+                    for (size_t k = i; k < i + n; ++k)
+                        cmd.append(token_t(argv[k], strlen(argv[k])));
+                }
+                i += n - 1;
+            }
+            if (ctx.compiler_is_clang) {
+                // validate the headers by size only, so that a PCH restored
+                // from the cache is accepted
+                cmd.append(token_t("-Xclang"));
+                cmd.append(token_t("-fno-pch-timestamp"));
+            }
+            cmd.append(token_t("-x"));
+            if (is_cpp_path(ctx.src_path)) cmd.append(token_t("c++-header"));
+            else                           cmd.append(token_t("c-header"));
+            cmd.append(header);
+            cmd.append(token_t("-o"));
+            cmd.append(output);
+            cmd.output(output);
+            append_depfile_args(cmd);
+
+            return _pch.find(equals, token_t(header.data(), header.size()));
+        }
+
+        // Precompile the common standard headers into the host-wide pool,
+        // see stdpch.hpp, unless the pool holds them for these flags already.
+        // Returns the path of the pool header.
+        const char* append_std_pch() {
+            if (not (ctx.compiler_is_clang or ctx.compiler_is_gcc)) return nullptr;
+            if (is_single_step()) return nullptr;
+
+            const bool cpp = is_cpp_path(ctx.src_path);
+            const buffer<char> header = stdpch::prepare(ctx, _pch, _compile, cpp);
+            return _pch.find(scan::equals, token_t(header.data(), header.size()));
+        }
+
+        // whether _compile does something other than compile & link
+        bool is_single_step() {
+            for (const char* arg : _compile) {
+                if (is_single_step_arg(token_t(arg, strlen(arg)))) return true;
+            }
+            return false;
+        }
+
+        // include the precompiled header ahead of the source compiled by cmd
+        void include_pch(command& cmd, const char* header) {
+            if (ctx.compiler_is_clang) {
+                cmd.append(token_t("-include-pch"));
+                cmd.append(token_t(_pch.output(), strlen(_pch.output())));
+            } else {
+                cmd.append(token_t("-include"));
+                cmd.append(token_t(header, strlen(header)));
+            }
+        }
+
+        // append the compile of source to _objects; returns the object path
+        const char* append_object(
+            const buffer<char>& object_dir,
+            const char* object_ext,
+            char** argv,
+            size_t argc,
+            const token_t& source
+        ) {
+            using namespace ::cxe::scan;
+            command& cmd = _objects.append();
+            cmd.append(token_t(argv[0], strlen(argv[0])));
+
+            for (size_t i = 1; i < argc; ++i) {
+                const token_t t { argv[i], strlen(argv[i]) };
+                const size_t n = takes_value(t) and i + 1 < argc ? 2 : 1;
+                if (is_object_arg(t, n)) {
+                    for (size_t k = i; k < i + n; ++k)
+                        cmd.append(token_t(argv[k], strlen(argv[k])));
+                }
+                i += n - 1;
+            }
+
+            buffer<char> object;
+            print_to(object, object_dir.data(), "/", source_stem(source), object_ext);
+            for (const command* other : _objects) {
+                if (0 != strcmp(other->output(), object.data())) continue;
+                // sources of the same name in different directories
+                object.clear();
+                print_to(object, object_dir.data(), "/", source_stem(source),
+                    "-", _objects.size(), object_ext);
+                break;
+            }
+
+            // module interfaces may need the language spelled out
+            modules::unit& unit = _units.emplace_back();
+            modules::scan(unit, source.data());
+            const bool named_as_module =
+                suffix(".cppm", source, ignore_case) or
+                suffix(".ixx",  source, ignore_case);
+            if (ctx.compiler_is_clang and unit.exports and not named_as_module) {
+                cmd.append(token_t("-x"));
+                cmd.append(token_t("c++-module"));
+            }
+            if (ctx.compiler_is_gcc and named_as_module) {
+                cmd.append(token_t("-x"));
+                cmd.append(token_t("c++"));
+            }
+
+            cmd.append(token_t("-c"));
+            cmd.append(source);
+            cmd.append(token_t("-o"));
+            cmd.append(object);
+            cmd.output(object);
+            append_depfile_args(cmd);
+            return cmd.output();
+        }
+
         const char* resolve_and_append_arg(const token_t& src, command& cmd) {
             const buffer<char> arg = resolve_arg(src);
             return cmd.append(arg);
@@ -448,20 +1761,28 @@ namespace cxe {
 
         void resolve_execute_cmd(const token_t& src) {
             const buffer<char> arg = resolve_arg(src);
+            _compile.output(arg);
 
-            size_t dir_size = 0;
+            size_t exe_index = 0;
             for (size_t i = 0; i < arg.size(); ++i) {
-                if (arg[i] == '/') dir_size = i;
+                if (arg[i] == '/') exe_index = i + 1;
             }
 
-            const token_t dir { arg.data(), dir_size };
-            _execute_cmd.dir(dir);
+            if (exe_index) {
+                const token_t dir { arg.data(), exe_index - 1 };
+                _execute_cmd.dir(dir);
+            }
 
-            const size_t exe_index = dir_size + 1;
             const size_t exe_size = arg.size() - exe_index;
             const token_t exe { &arg[exe_index], exe_size };
 
-            _execute_cmd.append(exe);
+            #if defined(_WIN32)
+                _execute_cmd.append(exe);
+            #else
+                // posix_spawnp() searches PATH for names without a slash
+                buffer<char> local; local << "./" << exe;
+                _execute_cmd.append(token_t(local.data(), local.size()));
+            #endif
         }
 
         buffer<char> resolve_arg(const token_t& src) {
@@ -477,12 +1798,10 @@ namespace cxe {
             // resolve explicit --target= to effective triple
             if (prefix("--target=", tok)) {
                 buffer<char> buf2; buf2 << "--target=";
-                buffer<char> cc;
-                cc << ctx.compiler_path << " " << tok;
-                cc << " -print-effective-triple";
-                if (const int status = shell::run(buf2, cc)) {
+                if (const int status = probe::triple(buf2, ctx.compiler_path, tok)) {
                     error(1,at(src),"failed to resolve --target: ",
-                        cc.data()," returned ",status);
+                        ctx.compiler_path," ",tok," -print-effective-triple",
+                        " returned ",status);
                 }
                 buf = std::move(buf2);
             }
@@ -1,14 +1,23 @@
 #pragma once
 #include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include "buffer.hpp"
 #include "scan.hpp"
 #include "verify.hpp"
 
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
 #ifdef _WIN32
-    #include <direct.h> // _chdir
+    #include <direct.h>    // _chdir, _mkdir
+    #include <io.h>        // _findfirst64, _findnext64
+    #include <sys/utime.h> // _utime
 #else
-    #include <unistd.h> // chdir
+    #include <dirent.h>    // opendir, readdir
+    #include <unistd.h>    // chdir
+    #include <utime.h>     // utime
 #endif
 
 namespace cxe::path {
@@ -46,7 +55,123 @@ namespace cxe::path {
         return path and not absolute(path);
     }
 
-    bool exists(const char* path);
+    struct info {
+        bool     exists = false;
+        bool     dir    = false;
+        bool     exec   = false;
+        uint64_t size   = 0;
+        int64_t  mtime  = 0; // nanoseconds since epoch
+        uint64_t inode  = 0;
+
+        explicit operator bool() const { return exists; }
+    };
+
+    info stat(const char* path) {
+        verify(path);
+
+        #ifdef _WIN32
+
+            struct _stat64 st;
+            if (0 != _stat64(path, &st)) return {};
+            return {
+                .exists = true,
+                .dir    = 0 != (st.st_mode & _S_IFDIR),
+                .exec   = 0 != (st.st_mode & _S_IEXEC),
+                .size   = uint64_t(st.st_size),
+                .mtime  = int64_t(st.st_mtime) * 1000000000,
+                .inode  = uint64_t(st.st_ino),
+            };
+
+        #else
+
+            struct ::stat st;
+            if (0 != ::stat(path, &st)) return {};
+            #if defined(__APPLE__)
+                const struct timespec& ts = st.st_mtimespec;
+            #else
+                const struct timespec& ts = st.st_mtim;
+            #endif
+            return {
+                .exists = true,
+                .dir    = S_ISDIR(st.st_mode),
+                .exec   = 0 != (st.st_mode & (S_IXUSR|S_IXGRP|S_IXOTH)),
+                .size   = uint64_t(st.st_size),
+                .mtime  = int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec,
+                .inode  = uint64_t(st.st_ino),
+            };
+
+        #endif
+    }
+
+    bool exists(const char* path) { return stat(path).exists; }
+
+    // update modification time of path to now
+    bool touch(const char* path) {
+        #ifdef _WIN32
+            return 0 == _utime(path, nullptr);
+        #else
+            return 0 == utime(path, nullptr);
+        #endif
+    }
+
+    // create directory path, including any missing parent directories
+    bool make_dirs(const char* path) {
+        verify(path);
+        buffer<char> buf; buf << path;
+        for (char* p = buf.data() + 1; ; ++p) {
+            const char c = *p;
+            if (c != 0 and c != '/' and c != '\\') continue;
+            *p = 0;
+            #ifdef _WIN32
+                const bool made = 0 == _mkdir(buf.data());
+            #else
+                const bool made = 0 == mkdir(buf.data(), 0777);
+            #endif
+            if (not made and not stat(buf.data()).dir) return false;
+            if (c == 0) return true;
+            *p = c;
+        }
+    }
+
+    bool remove(const char* path) { return 0 == ::remove(path); }
+
+    // replace dst with src, atomically where the platform allows
+    bool rename(const char* src, const char* dst) {
+        #ifdef _WIN32
+            ::remove(dst);
+        #endif
+        return 0 == ::rename(src, dst);
+    }
+
+    // invoke fn(name) for each entry of dir, excluding "." and ".."
+    template<typename Fn>
+    void each(const char* dir, Fn&& fn) {
+        #ifdef _WIN32
+
+            buffer<char> pattern; pattern << dir << "/*";
+            struct _finddata64i32_t fd;
+            const intptr_t h = _findfirst64i32(pattern.data(), &fd);
+            if (h == -1) return;
+            do {
+                if (0 == strcmp(fd.name, ".") or 0 == strcmp(fd.name, ".."))
+                    continue;
+                fn(static_cast<const char*>(fd.name));
+            } while (0 == _findnext64i32(h, &fd));
+            _findclose(h);
+
+        #else
+
+            DIR* const d = opendir(dir);
+            if (not d) return;
+            while (const struct dirent* e = readdir(d)) {
+                if (0 == strcmp(e->d_name, ".") or 0 == strcmp(e->d_name, ".."))
+                    continue;
+                fn(static_cast<const char*>(e->d_name));
+            }
+            closedir(d);
+
+        #endif
+    }
 
     void normalize(buffer<char>& path) {
         if (path.empty()) return;
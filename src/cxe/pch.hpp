@@ -0,0 +1,87 @@
+#pragma once
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "file.hpp"
+#include "path.hpp"
+#include "scan.hpp"
+
+// Precompiled header for the include prologue of the main source.
+//
+// With -pch, the leading block of #include lines of the main source, after
+// the cxe comment, is copied to prologue.h in the object store of the build
+// (see parser::store_dir()) and precompiled with the flags of the compile.
+// The compile of the main source then includes the precompiled header ahead
+// of its own text; the #include lines of the source still run, but find
+// every header already included.
+//
+// The header is only rewritten when the prologue changes, and the PCH is
+// built as a compile of its own, so the up-to-date check and the cache skip
+// it while neither the prologue nor any header it includes has changed.
+
+namespace cxe::pch {
+
+    // Copy the leading #include lines of text to dst, skipping blank lines
+    // and comments, up to the first line of any other kind.  Quoted includes
+    // of files in the working directory are made absolute, so that they are
+    // found from the directory of the generated header.  Returns the number
+    // of #include lines.
+    size_t prologue(buffer<char>& dst, const std::span<const char>& text) {
+        using namespace ::cxe::scan;
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+
+        size_t count = 0;
+        while (itr < end) {
+            skip_while(isspace, itr, end);
+
+            if (skip("//", itr, end)) {
+                seek('\n', itr, end);
+                continue;
+            }
+
+            if (skip("/*", itr, end)) {
+                if (not seek("*/", itr, end)) break;
+                skip("*/", itr, end);
+                continue;
+            }
+
+            end_t line = itr;
+            if (not skip('#', itr, end)) break;
+            skip_while(isblank, itr, end);
+            if (not skip("include", itr, end)) break;
+            skip_while(isblank, itr, end);
+
+            end_t name = itr;
+            seek('\n', itr, end);
+
+            if (name < itr and *name == '"') {
+                itr_t close = name + 1;
+                if (seek('"', close, itr)) {
+                    buffer<char> header;
+                    header << std::span<const char>(name + 1, close - name - 1);
+                    if (path::stat(header.data()).exists) {
+                        path::qualify(header);
+                        dst << "#include \"" << header.data() << "\"\n";
+                        ++count;
+                        continue;
+                    }
+                }
+            }
+
+            dst << std::span<const char>(line, itr - line) << "\n";
+            ++count;
+        }
+        return count;
+    }
+
+    // write text to path, unless path already holds it, so that its
+    // modification time only changes with its contents
+    bool write_header(const char* path, const buffer<char>& text) {
+        buffer<char> old;
+        if (file::load(path, old) and old.size() == text.size() and
+            0 == memcmp(old.data(), text.data(), text.size())) return true;
+        return file::save(path, text.data(), text.size());
+    }
+
+} // namespace cxe::pch
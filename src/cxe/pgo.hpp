@@ -0,0 +1,208 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+
+// Profile-guided optimization in one build.
+//
+// With -pgo, the build keeps an instrumentation profile of the program in
+// <output dir>/.cxe/<source name>-pgo/:
+//
+//     merged.profdata   the profile the compiles use
+//     sources           fingerprint of the sources the profile was made from
+//     raw/              raw profiles of the training runs
+//     instr-<name>      the instrumented program
+//
+// While the profile is current, the build compiles with
+// -fprofile-instr-use=merged.profdata.  Otherwise, ahead of the compile, it
+// builds the instrumented program with -fprofile-instr-generate, runs it
+// once per -train { args }, or with the arguments after --, merges the
+// raw profiles with llvm-profdata, and then compiles with the new profile.
+//
+// The profile stays current until the sources drift from its fingerprint by
+// more than CXE_PGO_DRIFT percent (default 10) of their size, counting the
+// size of every source added, removed or changed since.  Within that drift,
+// clang matches the profile to the functions which did not change.
+
+namespace cxe::pgo {
+
+    // CXE_PGO_DRIFT, in percent of the size of the sources
+    uint64_t max_drift() {
+        if (const char* const value = getenv("CXE_PGO_DRIFT")) {
+            char* end = nullptr;
+            const uint64_t n = strtoull(value, &end, 10);
+            if (end != value) return n;
+        }
+        return 10;
+    }
+
+    // one line of the fingerprint: "<16 hex digit hash> <size> <path>"
+    struct source {
+        buffer<char> path;
+        uint64_t     hash = 0;
+        uint64_t     size = 0;
+    };
+
+    bool scan(source& s, const char* path) {
+        s.path << path;
+        cxe::hash h;
+        if (not h.update_file(path)) return false;
+        s.hash = h.digest();
+        s.size = path::stat(path).size;
+        return true;
+    }
+
+    buffer<source> load(const char* fingerprint) {
+        using namespace ::cxe::scan;
+        buffer<source> sources;
+        buffer<char> text;
+        if (not file::load(fingerprint, text)) return sources;
+
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+        while (itr + 17 < end) {
+            itr_t eol = itr;
+            if (not seek('\n', eol, end)) break;
+            source& s = sources.emplace_back();
+            char* size_end = nullptr;
+            if (not hash::parse(itr, s.hash) or itr[16] != ' ') break;
+            s.size = strtoull(itr + 17, &size_end, 10);
+            if (size_end >= eol or *size_end != ' ') break;
+            s.path << token_t(size_end + 1, eol);
+            itr = eol + 1;
+        }
+        return sources;
+    }
+
+    void save(const char* fingerprint, const buffer<source>& sources) {
+        buffer<char> text;
+        char hex[17];
+        for (const source& s : sources)
+            println_to(text, hash::format(hex, s.hash), " ", s.size, " ", s.path.data());
+        file::save(fingerprint, text.data(), text.size());
+    }
+
+    // Percent of the size of the sources which differ from the fingerprint.
+    uint64_t drift(const buffer<source>& old, const buffer<source>& now) {
+        uint64_t total = 0, changed = 0;
+        for (const source& s : now) {
+            total += s.size;
+            bool same = false;
+            for (const source& o : old) {
+                if (strcmp(o.path.data(), s.path.data())) continue;
+                same = o.hash == s.hash;
+                break;
+            }
+            if (not same) changed += s.size;
+        }
+        for (const source& o : old) {
+            bool kept = false;
+            for (const source& s : now)
+                if (0 == strcmp(o.path.data(), s.path.data())) { kept = true; break; }
+            if (not kept) changed += o.size;
+        }
+        if (not total) return changed ? 100 : 0;
+        return changed * 100 / total;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // the profile the compiles of dir use
+    buffer<char> profile_path(const buffer<char>& dir) {
+        buffer<char> path; print_to(path, dir.data(), "/merged.profdata");
+        return path;
+    }
+
+    // Whether the profile in dir is current for the sources.  If not, clear
+    // dir for a new profile and record the fingerprint of the sources.
+    bool current(const buffer<char>& dir, const buffer<source>& sources) {
+        const buffer<char> profile = profile_path(dir);
+        buffer<char> fingerprint; print_to(fingerprint, dir.data(), "/sources");
+
+        if (path::exists(profile.data()) and
+            drift(load(fingerprint.data()), sources) <= max_drift()) return true;
+
+        // a failed training leaves no profile, so the next build retries
+        path::remove(profile.data());
+        buffer<char> raw; print_to(raw, dir.data(), "/raw");
+        path::make_dirs(raw.data());
+        buffer<buffer<char>> stale;
+        path::each(raw.data(), [&](const char* name) {
+            print_to(stale.emplace_back(), raw.data(), "/", name);
+        });
+        for (const buffer<char>& p : stale) path::remove(p.data());
+
+        save(fingerprint.data(), sources);
+        return false;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Append the steps which make the profile of dir to cmds: build names
+    // the arguments of the compile of the program less its output, and
+    // becomes the build of the instrumented program, which runs once per
+    // set of arguments of train.  Returns false if llvm-profdata is not
+    // found.
+    bool append_steps(
+        const context& ctx,
+        commands& cmds,
+        command& build,
+        const buffer<char>& dir,
+        const token_t& out_name,
+        commands& train
+    ) {
+        buffer<char> tool;
+        if (probe::tool(tool, ctx.compiler_path, "llvm-profdata")) return false;
+
+        const buffer<char> profile = profile_path(dir);
+        buffer<char> instr; instr << dir.data() << "/instr-" << out_name;
+        buffer<char> raw;   raw << dir.data() << "/raw";
+        buffer<char> generate;
+        generate << "-fprofile-instr-generate=" << raw.data() << "/%p.profraw";
+
+        build.name(token_t("pgo-instrument", 14));
+        build.append(generate);
+        build.append(token_t("-o", 2));
+        build.append(instr);
+        build.output(instr);
+
+        for (command* args : train) {
+            command& run = cmds.append();
+            run.name(token_t("pgo-train", 9));
+            run.after(token_t("pgo-instrument", 14));
+            run.append(instr);
+            for (const char* arg : *args) run.append(token_t(arg, strlen(arg)));
+        }
+
+        command& merge = cmds.append();
+        merge.name(token_t("pgo-merge", 9));
+        merge.after(token_t("pgo-train", 9));
+        merge.append(tool);
+        merge.append(token_t("merge", 5));
+        merge.append(token_t("-o", 2));
+        merge.append(profile);
+        merge.append(raw);
+        merge.output(profile);
+        return true;
+    }
+
+    // insert the arguments which compile with profile into cmd at index at
+    void insert_use_args(command& cmd, size_t at, const buffer<char>& profile) {
+        buffer<char> use; use << "-fprofile-instr-use=" << profile.data();
+        cmd.insert(at++, use);
+        // the profile is allowed to drift, see max_drift()
+        cmd.insert(at++, token_t("-Wno-profile-instr-out-of-date", 30));
+        cmd.insert(at++, token_t("-Wno-profile-instr-unprofiled", 29));
+    }
+
+} // namespace cxe::pgo
@@ -0,0 +1,285 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "verify.hpp"
+#include "async.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "probe.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// Post-link code layout optimization, with -post-link-opt.
+//
+// With llvm-bolt, the program links to <output dir>/.cxe/<source name>-
+// postlink/linked, with --emit-relocs, and three steps of optimize jobs,
+// which run between the link and the -post commands, make the output:
+//
+//     post-link-instrument   llvm-bolt -instrument the linked program
+//     post-link-train        run it, once per -train { <args> }, or with the
+//                            arguments after --, each writing prof.fdata.<pid>
+//     post-link-opt          merge the profiles with merge-fdata, lay out
+//                            the linked program with llvm-bolt to
+//                            <output>.tmp, and rename it to the output
+//
+// The result is kept in the compile cache, keyed on the contents of the
+// linked program and the cxe arguments, and the key of the output is kept in
+// postlink/stamp.  Every step is skipped while the stamp matches, and the
+// first step restores the output from the cache when it has it.
+//
+// Without llvm-bolt, a -pgo build linked by lld or mold gets a
+// --symbol-ordering-file listing the functions of its profile, hottest
+// first, written by write_order() as the link starts.
+
+namespace cxe::postlink {
+
+    // the linked program of cmd, see append_steps()
+    const char* linked(const command& cmd) {
+        verify(cmd.inputs().size());
+        return cmd.inputs()[0].data();
+    }
+
+    // directory of the linked program, the profiles and the stamp
+    buffer<char> dir(const command& cmd) {
+        const char* const path = linked(cmd);
+        const char* const slash = strrchr(path, '/');
+        buffer<char> buf;
+        buf << token_t(path, slash ? size_t(slash - path) : size_t(0));
+        return buf;
+    }
+
+    // the linked program and cxe arguments, hashed once per process
+    uint64_t key(const context& ctx, const command& cmd) {
+        static uint64_t memo = 0;
+        if (memo) return memo;
+        cxe::hash h;
+        h.update("cxe/postlink/1");
+        h.update(ctx.cli_text);
+        h.update(ctx.src_text);
+        if (not h.update_file(linked(cmd))) return 0;
+        return memo = h.digest();
+    }
+
+    // whether the output is the optimized program of key
+    bool current(const command& cmd, uint64_t key) {
+        if (not path::exists(cmd.output())) return false;
+        buffer<char> stamp; print_to(stamp, dir(cmd).data(), "/stamp");
+        buffer<char> text;
+        if (not file::load(stamp.data(), text) or text.size() < 16) return false;
+        const char* itr = text.data();
+        uint64_t k = 0;
+        return hash::parse(itr, k) and k == key;
+    }
+
+    void write_stamp(const command& cmd, uint64_t key) {
+        buffer<char> stamp; print_to(stamp, dir(cmd).data(), "/stamp");
+        char hex[17]; hash::format(hex, key);
+        file::save(stamp.data(), hex, 16);
+    }
+
+    // replace the output with temp, atomically
+    bool replace_output(const command& cmd, const char* temp, uint64_t key) {
+        if (not path::rename(temp, cmd.output())) return false;
+        write_stamp(cmd, key);
+        return true;
+    }
+
+    // Merge the profiles of the training runs into <dir>/prof.fdata.
+    async::task merge(command& cmd, async::loop& loop) {
+        const buffer<char> d = dir(cmd);
+        buffer<char> merged; print_to(merged, d.data(), "/prof.fdata");
+
+        buffer<buffer<char>> profiles;
+        path::each(d.data(), [&](const char* name) {
+            if (scan::prefix("prof.fdata.", token_t(name, strlen(name))))
+                print_to(profiles.emplace_back(), d.data(), "/", name);
+        });
+        if (profiles.empty()) {
+            println("post-link-opt: the training runs wrote no profile");
+            co_return 1;
+        }
+        if (profiles.size() == 1)
+            co_return path::rename(profiles[0].data(), merged.data()) ? 0 : 1;
+
+        buffer<char> tool;
+        if (probe::tool(tool, token_t(cmd.argv()[0], strlen(cmd.argv()[0])), "merge-fdata")) {
+            println("post-link-opt: merge-fdata not found");
+            co_return 1;
+        }
+        buffer<char*> argv;
+        argv.push_back(tool.data());
+        for (buffer<char>& p : profiles) argv.push_back(p.data());
+        argv.push_back(const_cast<char*>("-o"));
+        argv.push_back(merged.data());
+        argv.push_back(nullptr);
+        const int status = co_await loop.spawn(argv.data(), {});
+        for (const buffer<char>& p : profiles) path::remove(p.data());
+        co_return status;
+    }
+
+    // Run a step of the optimization, see above.
+    async::task run(const context& ctx, command& cmd, async::loop& loop, const char* echo) {
+        const uint64_t k = key(ctx, cmd);
+        if (k and current(cmd, k)) co_return 0;
+
+        buffer<char> temp; temp << cmd.output() << ".tmp";
+        const bool first = 0 == strcmp(cmd.name(), "post-link-instrument");
+        const bool last  = 0 == strcmp(cmd.name(), "post-link-opt");
+
+        if (first) {
+            // profiles of an earlier run would skew this one
+            const buffer<char> d = dir(cmd);
+            buffer<buffer<char>> stale;
+            path::each(d.data(), [&](const char* name) {
+                if (scan::prefix("prof.fdata", token_t(name, strlen(name))))
+                    print_to(stale.emplace_back(), d.data(), "/", name);
+            });
+            for (const buffer<char>& p : stale) path::remove(p.data());
+
+            if (k and cache::enabled() and cache::restore(k, temp.data())) {
+                if (echo) println("post-link-opt: ", cmd.output(), " restored from cache");
+                co_return replace_output(cmd, temp.data(), k) ? 0 : 1;
+            }
+        }
+
+        if (last) {
+            if (const int status = co_await merge(cmd, loop)) co_return status;
+        }
+
+        const int status = co_await loop.spawn(cmd.argv(), { .echo = echo });
+        if (status or not last) co_return status;
+
+        if (not replace_output(cmd, temp.data(), k)) co_return 1;
+        if (k and cache::enabled()) {
+            path::make_dirs(cache::path_to("/r").data());
+            cache::store(k, cmd.output(), buffer<char>());
+            cache::evict();
+        }
+        co_return 0;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // the program the link writes into dir for llvm-bolt
+    buffer<char> linked_path(const buffer<char>& dir) {
+        buffer<char> path; print_to(path, dir.data(), "/linked");
+        return path;
+    }
+
+    // append the arguments which keep the relocations llvm-bolt needs to
+    // the link cmd, whose output is linked_path()
+    void append_link_args(command& cmd) {
+        cmd.append(token_t("-Wl,--emit-relocs", 17));
+    }
+
+    // Append the steps of the optimization with llvm-bolt to cmds, see
+    // above, which make output from the linked program in dir, with one
+    // training run per set of arguments of train.
+    void append_steps(
+        commands& cmds,
+        const buffer<char>& bolt,
+        const buffer<char>& dir,
+        const char* output,
+        commands& train
+    ) {
+        const buffer<char> linked = linked_path(dir);
+        buffer<char> instr; instr << dir.data() << "/instr";
+        buffer<char> fdata; fdata << dir.data() << "/prof.fdata";
+        buffer<char> temp;  temp << output << ".tmp";
+
+        auto append = [&](const char* name) -> command& {
+            command& cmd = cmds.append();
+            cmd.name(token_t(name, strlen(name)));
+            cmd.input(linked);
+            cmd.output(token_t(output, strlen(output)));
+            return cmd;
+        };
+        auto append_args = [](command& cmd, std::initializer_list<const char*> args) {
+            for (const char* arg : args) cmd.append(token_t(arg, strlen(arg)));
+        };
+
+        command& instrument = append("post-link-instrument");
+        buffer<char> file; file << "--instrumentation-file=" << fdata.data();
+        append_args(instrument, { bolt.data(), linked.data(), "-instrument",
+            file.data(), "--instrumentation-file-append-pid",
+            "-o", instr.data() });
+
+        for (command* args : train) {
+            command& run = append("post-link-train");
+            run.after(token_t("post-link-instrument", 20));
+            run.append(instr);
+            for (const char* arg : *args) run.append(token_t(arg, strlen(arg)));
+        }
+
+        command& opt = append("post-link-opt");
+        opt.after(token_t("post-link-train", 15));
+        buffer<char> data; data << "-data=" << fdata.data();
+        append_args(opt, { bolt.data(), linked.data(), "-o", temp.data(),
+            data.data(), "-reorder-blocks=ext-tsp",
+            "-reorder-functions=hfsort", "-split-functions",
+            "-split-all-cold", "-dyno-stats" });
+    }
+
+    // append the --symbol-ordering-file of dir, see write_order(), to the
+    // link cmd, which lld must not warn about
+    void append_order_args(command& cmd, const buffer<char>& dir, bool lld) {
+        buffer<char> order; order << "-Wl,--symbol-ordering-file=" << dir.data() << "/order.txt";
+        cmd.append(order);
+        if (lld) cmd.append(token_t("-Wl,--no-warn-symbol-ordering", 29));
+    }
+
+    // With a --symbol-ordering-file, write it from the profile of the link
+    // cmd, unless it is newer than the profile.
+    void write_order(const context& ctx, command& cmd) {
+        using namespace ::cxe::scan;
+        const char* const arg = cmd.find(prefix, token_t("-Wl,--symbol-ordering-file=", 27));
+        if (not arg) return;
+        const char* const order = arg + 27;
+
+        const char* profile = nullptr;
+        for (const buffer<char>& input : cmd.inputs()) {
+            if (suffix(".profdata", token_t(input.data(), input.size()))) profile = input.data();
+        }
+        if (not profile) return;
+        const path::info p = path::stat(profile), o = path::stat(order);
+        if (not p or (o and o.mtime >= p.mtime)) return;
+
+        buffer<char> tool;
+        if (probe::tool(tool, ctx.compiler_path, "llvm-profdata")) return;
+        char topn[] = "--topn=1000000";
+        char show[] = "show";
+        char* argv[] = { tool.data(), show, topn, const_cast<char*>(profile), nullptr };
+        buffer<char> text;
+        if (shell::capture_argv(text, argv)) return;
+
+        // "  <name>, max count = <n>", where the name of a static function
+        // is prefixed by its file and a ':' or ';'
+        buffer<char> names;
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+        while (itr < end) {
+            itr_t line = itr;
+            if (not seek('\n', itr, end)) itr = end;
+            token_t t { line, itr };
+            skip('\n', itr, end);
+            if (not skip("  ", t)) continue;
+            token_t name = t;
+            if (not seek(", max count", name)) continue;
+            name = token_t(t.data(), name.data());
+            for (itr_t c = name.data() + name.size(); c > name.data(); --c) {
+                if (c[-1] != ':' and c[-1] != ';') continue;
+                name = token_t(c, name.data() + name.size());
+                break;
+            }
+            names << name << "\n";
+        }
+        file::save(order, names.data(), names.size());
+    }
+
+} // namespace cxe::postlink
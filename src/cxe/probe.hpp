@@ -0,0 +1,278 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <unordered_set>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "environment.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "scan.hpp"
+#include "shell.hpp"
+
+// Persistent cache of toolchain probes, e.g. "<cc> -print-effective-triple"
+// and the PATH lookup of the default compilers.
+//
+// Each probe result is stored under a key hashing the probe, the compiler
+// path, the compiler's size/mtime/inode, and any target arguments.  Results
+// are appended to <cache dir>/probes, and exported to the environment as
+// CXE_PROBE_<key>=<value>, so that nested "$CXE dep.c" invocations find them
+// without touching the disk at all.  Once the store grows too large, the
+// first store() of a process rewrites it from its live entries.
+
+namespace cxe::probe {
+
+    using span_t = std::span<const char>;
+
+    // strip the quotes that path::normalize() adds to paths with whitespace
+    void unquote(buffer<char>& buf) {
+        if (buf.size() >= 2 and buf.front() == '"' and buf.back() == '"') {
+            buf.pop_back();
+            buf.erase(buf.begin());
+        }
+    }
+
+    uint64_t key(const char* probe, span_t compiler, span_t args = {}) {
+        buffer<char> compiler_path; compiler_path << compiler;
+        unquote(compiler_path);
+        const path::info info = path::stat(compiler_path.data());
+
+        cxe::hash h;
+        h.update("cxe/probe/1");
+        h.update(probe);
+        h.update(compiler_path.data());
+        h.update(info.size);
+        h.update(info.mtime);
+        h.update(info.inode);
+        h.update(args);
+        return h.digest();
+    }
+
+    //--------------------------------------------------------------------------
+
+    buffer<char> env_name(uint64_t key) {
+        char hex[17];
+        buffer<char> buf; buf << "CXE_PROBE_" << hash::format(hex, key);
+        return buf;
+    }
+
+    // export key=value to the environment of child processes
+    void export_env(uint64_t key, const buffer<char>& value) {
+        // putenv() retains the string, so the variable must outlive us
+        new environment::variable(env_name(key), value);
+    }
+
+    const buffer<char>& store_path() {
+        static const buffer<char> buf = cache::path_to("/probes");
+        return buf;
+    }
+
+    // contents of the persistent probe store, loaded on first use
+    buffer<char>& store_text() {
+        static buffer<char> text = []() -> auto {
+            buffer<char> text;
+            file::load(store_path().data(), text);
+            return text;
+        }();
+        return text;
+    }
+
+    bool lookup(uint64_t key, buffer<char>& value) {
+        if (const char* const env = getenv(env_name(key).data())) {
+            value << env;
+            return true;
+        }
+
+        // each line of the store is "<16 hex digit key> <value>"
+        using namespace ::cxe::scan;
+        const buffer<char>& text = store_text();
+        itr_t itr = text.data();
+        end_t end = itr + text.size();
+        while (itr + 17 < end) {
+            itr_t eol = itr;
+            if (not seek('\n', eol, end)) break;
+            uint64_t k = 0;
+            if (hash::parse(itr, k) and k == key and itr[16] == ' ') {
+                value << token_t(itr + 17, eol);
+                export_env(key, value);
+                return true;
+            }
+            itr = eol + 1;
+        }
+        return false;
+    }
+
+    constexpr size_t max_store_size = 256 * 1024;
+
+    // rewrite the store from its live entries: the newest line of each key,
+    // newest keys first, up to half of max_store_size
+    void compact() {
+        using namespace ::cxe::scan;
+        buffer<char>& text = store_text();
+
+        std::unordered_set<uint64_t> keys;
+        buffer<token_t> lines;
+        size_t size = 0;
+        itr_t end = text.data() + text.size();
+        while (end > text.data() and size < max_store_size / 2) {
+            itr_t itr = end - 1;
+            while (itr > text.data() and itr[-1] != '\n') --itr;
+            uint64_t k = 0;
+            if (end - itr > 17 and end[-1] == '\n' and itr[16] == ' '
+                and hash::parse(itr, k) and keys.insert(k).second) {
+                lines.emplace_back(itr, end);
+                size += end - itr;
+            }
+            end = itr;
+        }
+
+        buffer<char> live;
+        for (size_t i = lines.size(); i-- > 0; ) live << lines[i];
+        if (file::save(store_path().data(), live.data(), live.size()))
+            text = std::move(live);
+    }
+
+    void store(uint64_t key, const buffer<char>& value) {
+        export_env(key, value);
+
+        if (scan::contains("\n", value)) return;
+
+        // compact the store once it has accumulated many stale entries
+        static bool compacted = false;
+        if (not compacted and store_text().size() > max_store_size) {
+            compacted = true;
+            compact();
+        }
+
+        char hex[17];
+        buffer<char> line;
+        println_to(line, hash::format(hex, key), " ", value);
+
+        // a single small append is atomic, so concurrent cxe processes
+        // can share the store without locking
+        path::make_dirs(cache::dir());
+        file f { store_path().data(), "ab" };
+        f.write(line.data(), line.size());
+    }
+
+    //--------------------------------------------------------------------------
+
+    // shell::which(), cached per PATH
+    int which(buffer<char>& out, const char* cmd) {
+        const char* const env_path = getenv("PATH");
+        const span_t path_span = env_path
+            ? span_t(env_path, strlen(env_path))
+            : span_t();
+        const uint64_t k = key("which", { cmd, strlen(cmd) }, path_span);
+
+        buffer<char> value;
+        if (lookup(k, value) and path::stat(value.data()).exec) {
+            out << value.data();
+            return 0;
+        }
+
+        value.clear();
+        if (const int status = shell::which(value, cmd)) return status;
+        store(k, value);
+        out << value.data();
+        return 0;
+    }
+
+    // Find the tool name, e.g. llvm-profdata, beside compiler, or else on
+    // the PATH, so that a versioned toolchain finds its own tools.
+    int tool(buffer<char>& out, span_t compiler, const char* name) {
+        using namespace ::cxe::scan;
+        buffer<char> compiler_path; compiler_path << compiler;
+        unquote(compiler_path);
+        token_t stem { compiler_path.data(), compiler_path.size() };
+        while (seek("/", stem) and skip("/", stem));
+        if (stem.data() != compiler_path.data()) {
+            buffer<char> sibling;
+            sibling << token_t(compiler_path.data(), stem.data()) << name;
+            if (path::stat(sibling.data()).exec) {
+                out << sibling.data();
+                return 0;
+            }
+        }
+        return which(out, name);
+    }
+
+    //--------------------------------------------------------------------------
+
+    // a triple probe started ahead of time, see speculate()
+    struct pending {
+        uint64_t     key = 0;
+        shell::child child;
+
+        ~pending() { finish(nullptr); }
+
+        // collect the probe's output, and store it if it succeeded;
+        // appends the output to out, if not null, and returns the status
+        int finish(buffer<char>* out) {
+            if (not child) return -1;
+            buffer<char> value;
+            const int status = child.finish(value);
+            if (status == 0) store(key, value);
+            if (out) *out << value.data();
+            key = 0;
+            return status;
+        }
+    };
+
+    pending& speculative() {
+        static pending p;
+        return p;
+    }
+
+    // "<compiler> [args] -print-effective-triple", run without a shell
+    struct triple_command {
+        buffer<char> compiler;
+        buffer<char> args;
+        char*        argv[4] = {};
+
+        triple_command(span_t compiler_span, span_t args_span) {
+            compiler << compiler_span;
+            unquote(compiler);
+            if (args_span.size()) args << args_span;
+            char** argp = argv;
+            *argp++ = compiler.data();
+            if (args.size()) *argp++ = args.data();
+            *argp++ = const_cast<char*>("-print-effective-triple");
+        }
+    };
+
+    // Start probing the default target of compiler without waiting for the
+    // result, so that the probe overlaps with reading and parsing the source.
+    void speculate(span_t compiler) {
+        if (not scan::contains("clang", compiler)) return;
+
+        const uint64_t k = key("triple", compiler);
+        buffer<char> value;
+        if (lookup(k, value)) return;
+
+        triple_command cmd { compiler, {} };
+        pending& p = speculative();
+        if (p.child.start(cmd.argv)) p.key = k;
+    }
+
+    // Append the effective triple of compiler for the given target arguments
+    // to out.  Returns the exit status of the probe, or zero if cached.
+    int triple(buffer<char>& out, span_t compiler, span_t args = {}) {
+        const uint64_t k = key("triple", compiler, args);
+        if (lookup(k, out)) return 0;
+
+        pending& p = speculative();
+        if (p.key == k) return p.finish(&out);
+
+        triple_command cmd { compiler, args };
+        buffer<char> value;
+        if (const int status = shell::capture_argv(value, cmd.argv)) return status;
+        store(k, value);
+        out << value.data();
+        return 0;
+    }
+
+} // namespace cxe::probe
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include "verify.hpp"
+#include "buffer.hpp"
+
+namespace cxe::record {
+
+    // appends fixed-size values and length-prefixed strings to a buffer
+    class writer {
+        buffer<char>& _buf;
+
+    public:
+
+        writer(buffer<char>& buf) : _buf(buf) {}
+
+        template<typename T>
+        writer& write(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const char* const p = reinterpret_cast<const char*>(&value);
+            _buf.insert(_buf.end(), p, p + sizeof(T));
+            return *this;
+        }
+
+        writer& write_string(const char* str, size_t len) {
+            write(uint32_t(len));
+            _buf.insert(_buf.end(), str, str + len);
+            return *this;
+        }
+
+        writer& write_string(const char* str) {
+            return write_string(str, strlen(str));
+        }
+    };
+
+    // reads values written by record::writer, failing on truncated input
+    class reader {
+        const char* _itr;
+        const char* const _end;
+        bool _ok = true;
+
+    public:
+
+        reader(const char* data, size_t size) : _itr(data), _end(data + size) {}
+
+        reader(const buffer<char>& buf) : reader(buf.data(), buf.size()) {}
+
+        explicit operator bool() const { return _ok; }
+
+        bool done() const { return _itr >= _end; }
+
+        template<typename T>
+        T read() {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value {};
+            if (not _ok or size_t(_end - _itr) < sizeof(T)) {
+                _ok = false;
+                return value;
+            }
+            memcpy(&value, _itr, sizeof(T));
+            _itr += sizeof(T);
+            return value;
+        }
+
+        // read a length-prefixed string into dst, replacing its contents
+        bool read_string(buffer<char>& dst) {
+            const uint32_t len = read<uint32_t>();
+            if (not _ok or size_t(_end - _itr) < len) return _ok = false;
+            dst.clear();
+            dst.insert(dst.end(), _itr, _itr + len);
+            _itr += len;
+            return true;
+        }
+    };
+
+} // namespace cxe::record
@@ -0,0 +1,260 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "verify.hpp"
+#include "async.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "cc1.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "deps.hpp"
+#include "file.hpp"
+#include "jobserver.hpp"
+#include "print.hpp"
+#include "scan.hpp"
+#include "postlink.hpp"
+#include "stdpch.hpp"
+#include "thinlto.hpp"
+
+#if defined(__linux__)
+    #include <sched.h>
+#endif
+
+// Runs the commands produced by parser::parse() as a dependency graph:
+//
+//   - -pre commands run concurrently, except as ordered by after(...)
+//   - with -march-variants=, the variants of the program are built by
+//     nested cxe processes once every -pre command has finished, ahead of
+//     the compile of their launcher, see march.hpp
+//   - with -pgo, a profile which is not current is remade once every -pre
+//     command has finished: build, train and merge, see pgo.hpp
+//   - with -pch or -std-pch, the precompiled header is built once every
+//     -pre command has finished, ahead of the compile
+//   - the compile starts once every -pre command has finished; when it
+//     names several sources, each compiles to an object in its own job,
+//     and one link of the objects follows, see parser::fan_out()
+//   - with -post-link-opt, the layout of the linked program is optimized
+//     after the link, see postlink.hpp
+//   - -post commands run concurrently once the compile has finished
+//   - the executable runs last
+//
+// At most -j commands run at once, by default one per available CPU, and
+// each command first takes a slot from the jobserver shared with nested cxe
+// and make processes, see jobserver.hpp.  Once a command fails no further
+// commands start, and the exit status of the first failure is returned when
+// the running commands have finished.
+
+namespace cxe::schedule {
+
+    // Number of CPUs available to this process, honoring its affinity mask
+    // and the CPU quota of its cgroup, e.g. when running in a container.
+    size_t default_jobs() {
+        size_t cpus = std::thread::hardware_concurrency();
+
+        #if defined(__linux__)
+
+            cpu_set_t set;
+            if (0 == sched_getaffinity(0, sizeof(set), &set))
+                cpus = size_t(CPU_COUNT(&set));
+
+            // cgroup v2 "<quota> <period>", or "max <period>" if unlimited;
+            // cgroup v1 splits the same into two files, with -1 as unlimited
+            long long quota = 0, period = 0;
+            buffer<char> text;
+            if (file::load("/sys/fs/cgroup/cpu.max", text)) {
+                if (2 != sscanf(text.data(), "%lld %lld", &quota, &period))
+                    quota = 0;
+            } else if (file::load("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", text)) {
+                sscanf(text.data(), "%lld", &quota);
+                text.clear();
+                if (file::load("/sys/fs/cgroup/cpu/cpu.cfs_period_us", text))
+                    sscanf(text.data(), "%lld", &period);
+            }
+
+            if (quota > 0 and period > 0) {
+                const size_t quota_cpus = size_t((quota + period - 1) / period);
+                if (quota_cpus < cpus) cpus = quota_cpus;
+            }
+
+        #endif
+
+        return cpus ? cpus : 1;
+    }
+
+    //--------------------------------------------------------------------------
+
+    class graph {
+        struct job {
+            command*       cmd;
+            buffer<size_t> after;
+            bool           started = false;
+            bool           done    = false;
+
+            explicit job(command* cmd) : cmd(cmd), after() {}
+        };
+
+        const context&     ctx;
+        jobserver::client& _jobserver;
+        async::loop        _loop;
+        buffer<job>    _jobs;
+        size_t         _limit;
+        size_t         _running = 0;
+        int            _status  = 0;
+
+        graph(const graph&) = delete;
+        graph& operator=(const graph&) = delete;
+
+        bool ready(const job& j) const {
+            for (const size_t i : j.after) {
+                if (not _jobs[i].done) return false;
+            }
+            return true;
+        }
+
+        // start every job whose prerequisites are done, up to the limit
+        void dispatch() {
+            for (job& j : _jobs) {
+                if (_status or _running >= _limit) return;
+                if (j.started or not ready(j)) continue;
+                j.started = true;
+                ++_running;
+                _loop.start(run(j));
+            }
+        }
+
+        async::task run(job& j) {
+            const bool token = co_await _jobserver.acquire(_loop);
+            const int status = co_await execute(*j.cmd);
+            _jobserver.release(token);
+            j.done = true;
+            --_running;
+            if (status and not _status) _status = status;
+            dispatch();
+            co_return status;
+        }
+
+        async::task execute(command& cmd) {
+            buffer<char> cmdline;
+            for (const char* arg : cmd) {
+                if (cmdline.size())
+                    cmdline << " ";
+                cmdline << arg;
+            }
+
+            // nested cxe invocations announce their own commands
+            const char* const echo =
+                scan::prefix(ctx.cxe_path, cmdline) ? nullptr : cmdline.data();
+
+            if (cmd.kind() == command::pch and stdpch::pooled(cmd)) {
+                // the pool is shared with other processes, see stdpch.hpp
+                co_return co_await stdpch::build(cmd, _loop, echo);
+            }
+
+            if (cmd.kind() == command::pch or cmd.kind() == command::compile) {
+                // skip the compile if its output is newer than all inputs
+                if (deps::up_to_date(cmd)) co_return 0;
+                postlink::write_order(ctx, cmd);
+                const int status = co_await cache::run(ctx, cmd, _loop, echo);
+                if (status == 0) deps::record(cmd);
+                co_return status;
+            }
+
+            if (cmd.kind() == command::link) {
+                // skip the link if no object was rebuilt
+                if (deps::up_to_date(cmd)) co_return 0;
+                postlink::write_order(ctx, cmd);
+                const thinlto::snapshot cached { cmd };
+                const int status = co_await cc1::run(
+                    ctx, cmd, _loop, { .echo = echo }, cache::path_to("/cc1"));
+                if (status == 0) cached.report();
+                if (status == 0) deps::record(cmd);
+                co_return status;
+            }
+
+            if (cmd.kind() == command::optimize) {
+                co_return co_await postlink::run(ctx, cmd, _loop, echo);
+            }
+
+            const async::options opt {
+                .dir     = cmd.dir()[0] ? cmd.dir() : nullptr,
+                .echo    = echo,
+                .capture = cmd.kind() != command::execute,
+            };
+            co_return co_await _loop.spawn(cmd.argv(), opt);
+        }
+
+        // add an edge from every job named name to job i
+        void add_after(size_t i, const buffer<char>& name) {
+            bool found = false;
+            for (size_t k = 0; k < _jobs.size(); ++k) {
+                if (k == i or strcmp(_jobs[k].cmd->name(), name.data()))
+                    continue;
+                _jobs[i].after.push_back(k);
+                found = true;
+            }
+            if (not found) {
+                error(1,{},"unknown command \"",name.data(),"\" in after(...)");
+            }
+        }
+
+    public:
+
+        graph(
+            const context& ctx,
+            buffer<command>& cmds,
+            size_t limit,
+            jobserver::client& js
+        )
+        : ctx(ctx)
+        , _jobserver(js)
+        , _limit(js.serial() ? 1 : limit ? limit : default_jobs()) {
+            _jobs.reserve(cmds.size());
+            for (command& cmd : cmds) _jobs.emplace_back(&cmd);
+
+            for (size_t i = 0; i < _jobs.size(); ++i) {
+                const command::kind_t kind = _jobs[i].cmd->kind();
+                for (size_t k = 0; k < _jobs.size(); ++k) {
+                    const command::kind_t other = _jobs[k].cmd->kind();
+                    if (other < kind) _jobs[i].after.push_back(k);
+                }
+                for (const buffer<char>& name : _jobs[i].cmd->after()) {
+                    add_after(i, name);
+                }
+            }
+        }
+
+        int run() {
+            dispatch();
+            _loop.run();
+
+            if (_status) return _status;
+
+            // jobs are only left waiting on one another in a cycle
+            buffer<char> names;
+            for (const job& j : _jobs) {
+                if (j.done or not j.cmd->name()[0]) continue;
+                if (names.size()) names << ", ";
+                names << j.cmd->name();
+            }
+            if (names.size()) {
+                error(1,{},"cyclic after(...) dependencies between: ",names.data());
+            }
+            return 0;
+        }
+    };
+
+    // run cmds, at most jobs at a time, or default_jobs() if zero
+    int run(
+        const context& ctx,
+        buffer<command>& cmds,
+        size_t jobs,
+        jobserver::client& js
+    ) {
+        graph g { ctx, cmds, jobs, js };
+        return g.run();
+    }
+
+} // namespace cxe::schedule
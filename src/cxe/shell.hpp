@@ -1,15 +1,28 @@
 #pragma once
 
-#if defined(__APPLE__)
+#if not defined(_WIN32)
+    #include <errno.h>
+    #include <signal.h>
     #include <spawn.h>
+    #include <sys/wait.h>
     extern "C" {
         extern char** environ;
     }
 #endif
 
 #include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
 #include "buffer.hpp"
 #include "file.hpp"
+#include "path.hpp"
 #include "print.hpp"
 #include "scan.hpp"
 #include "verify.hpp"
@@ -125,22 +138,90 @@ namespace cxe::shell {
             int*  lpExitCode
         );
 
+        extern "C"
+        int __stdcall
+        ReadFile(
+            void*     hFile,
+            void*     lpBuffer,
+            uint32_t  nNumberOfBytesToRead,
+            uint32_t* lpNumberOfBytesRead,
+            void*     lpOverlapped
+        );
+
     } // namespace _win32
+    #else
+    namespace _posix {
+
+        // decode a waitpid() status the way a shell does: the exit code of
+        // a process that exited, or 128 + the signal that terminated it
+        int decode_status(const char* name, int status) {
+            if (WIFEXITED(status)) return WEXITSTATUS(status);
+            if (WIFSIGNALED(status)) {
+                const int sig = WTERMSIG(status);
+                using namespace escape_codes;
+                fflush(stdout);
+                printerrln(LTRED,"error: ",RESET,"\"",name,"\" terminated by ",
+                    "signal ",sig," (",strsignal(sig),")");
+                return 128 + sig;
+            }
+            return -1;
+        }
+
+        // Spawn argv[0], searching PATH like execvp().  glibc implements
+        // posix_spawn with clone(CLONE_VM|CLONE_VFORK), so the child
+        // shares our address space until it execs, and a parent with a
+        // large resident set pays no page table copy, unlike fork().
+        pid_t spawn(
+            char* const argv[],
+            const posix_spawn_file_actions_t* actions = nullptr
+        ) {
+            posix_spawnattr_t attr;
+            posix_spawnattr_init(&attr);
+            #if defined(POSIX_SPAWN_USEVFORK)
+                posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK);
+            #endif
+
+            pid_t pid = -1;
+            const int result =
+                posix_spawnp(&pid, argv[0], actions, &attr, argv, environ);
+            posix_spawnattr_destroy(&attr);
+
+            if (result) {
+                using namespace escape_codes;
+                fflush(stdout);
+                printerrln(LTRED,"error: ",RESET,"failed to run \"",argv[0],
+                    "\": ",strerror(result));
+                return -1;
+            }
+            return pid;
+        }
+
+        // wait for pid to terminate, and return its decoded exit status
+        int wait(const char* name, pid_t pid) {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0) {
+                if (errno != EINTR) return -1;
+            }
+            return decode_status(name, status);
+        }
+
+    } // namespace _posix
     #endif
 
     //--------------------------------------------------------------------------
 
-    void normalize_newlines(buffer<char>& buf) {
-        using namespace scan;
-        char* wr = buf.data();
-        itr_t rd = wr;
-        end_t end = wr + buf.size() - 1;
-        for (; rd < end; ++rd, ++wr) {
-            if (prefix("\r\n", rd, end)) {
-                *wr = '\n'; ++rd;
-            }
+    // replace each "\r\n" in buf[start:] with "\n", in a single pass
+    void normalize_newlines(buffer<char>& buf, size_t start = 0) {
+        verify(start <= buf.size());
+        char* const begin = buf.data();
+        const char* const end = begin + buf.size();
+        const char* rd = begin + start;
+        char* wr = begin + start;
+        for (; rd < end; ++rd) {
+            if (rd[0] == '\r' and rd + 1 < end and rd[1] == '\n') continue;
+            *wr++ = *rd;
         }
-        *wr = 0;
+        buf.resize(wr - begin);
     }
 
     void trim_trailing_newlines(buffer<char>& buf) {
@@ -195,19 +276,30 @@ namespace cxe::shell {
 
             return exit_code;
 
-        #elif defined(__APPLE__)
+        #else
 
-            verify(false); // todo
-            return -1;
+            using namespace ::cxe::shell::_posix;
+
+            char* const argv[] = {
+                const_cast<char*>("/bin/sh"),
+                const_cast<char*>("-c"),
+                const_cast<char*>(cmd),
+                nullptr
+            };
+
+            const pid_t pid = spawn(argv);
+            if (pid < 0) return -1;
+
+            return wait(cmd, pid);
 
         #endif
     }
 
     int run_argv(char* argv[]) {
-        int status = -1;
-
         #if defined(_WIN32)
 
+            int status = -1;
+
             using namespace ::cxe::shell::_win32;
 
             STARTUPINFOA si {
@@ -250,71 +342,14 @@ namespace cxe::shell {
 
             // todo: try _spawnv() instead
 
-        #elif defined(__APPLE__)
+        #else
 
-            pid_t pid;
+            using namespace ::cxe::shell::_posix;
 
-            buffer<char> buf;
-            shell::which(buf, argv[0]);
-            const char* path = buf.data();
-
-            int result = posix_spawn(&pid, path, nullptr, nullptr, argv, environ);
-
-            switch (result) {
-                case EINVAL:            //The value specified by file_actions or attrp is
-                print("\nEINVAL");      //invalid.
-                break;
-
-                case E2BIG:             //The number of bytes in the new process's argument list
-                print("\nE2BIG");       //is larger than the system-imposed limit.  This limit
-                break;                  //is specified by the sysctl(3) MIB variable
-                                        //KERN_ARGMAX.
-
-                case EACCES:            //Search permission is denied for a component of the
-                print("\nEACCES");      //path prefix.
-                break;                  //The new process file is not an ordinary file.
-                                        //The new process file mode denies execute permission.
-                                        //The new process file is on a filesystem mounted with
-                                        //execution disabled (MNT_NOEXEC in <sys/mount.h>).
-
-                case EFAULT:            //The new process file is not as long as indicated by
-                print("\nEFAULT");        //the size values in its header.
-                break;                  //Path, argv, or envp point to an illegal address.
-
-                case EIO:               //An I/O error occurred while reading from the file system.
-                print("\nEIO");
-                break;
-
-                case ELOOP:             //Too many symbolic links were encountered in translating
-                print("\nELOOP");       //the pathname.  This is taken to be indicative of a
-                break;                  //looping symbolic link.
-
-                case ENAMETOOLONG:      //A component of a pathname exceeded {NAME_MAX} characters,
-                print("\nENAMETOOLONG");//or an entire path name exceeded {PATH_MAX} characters.
-                break;
-
-                case ENOENT:            //The new process file does not exist.
-                print("\nENOENT");
-                break;
-
-                case ENOEXEC:           //The new process file has the appropriate access permission,
-                print("\nENOEXEC");     //but has an unrecognized format (e.g., an
-                break;                  //invalid magic number in its header).
-
-                case ENOMEM:            //The new process requires more virtual memory than is
-                print("\nENOMEM");      //allowed by the imposed maximum (getrlimit(2)).
-                break;
-
-                case ENOTDIR:           //A component of the path prefix is not a directory.
-                print("\nENOTDIR");
-                break;
-
-                case ETXTBSY:           //The new process file is a pure procedure (shared text)
-                print("\nETXTBSY");     //file that is currently open for writing or reading by
-                break;                  //some process.
-            }
+            const pid_t pid = spawn(argv);
+            if (pid < 0) return -1;
 
-            if (pid == waitpid(pid, &status, 0)) return status;
+            return wait(argv[0], pid);
 
         #endif
 
@@ -335,19 +370,227 @@ namespace cxe::shell {
 
     //--------------------------------------------------------------------------
 
+    // A child process whose stdout, and optionally its stderr, is captured
+    // through a pipe.  The child runs concurrently with us from start() until finish() collects its
+    // output, reading the pipe in large chunks straight into the buffer.
+    class child {
+        #if defined(_WIN32)
+            void* _process = nullptr;
+            void* _pipe    = nullptr;
+        #else
+            pid_t _pid     = -1;
+            int   _pipe    = -1;
+        #endif
+
+        buffer<char> _name;
+
+        child(const child&) = delete;
+        child& operator=(const child&) = delete;
+
+        static constexpr size_t CHUNK = 64 * 1024;
+
+    public:
+
+        child() = default;
+
+        ~child() { if (*this) { buffer<char> discard; finish(discard); } }
+
+        explicit operator bool() const {
+            #if defined(_WIN32)
+                return _process != nullptr;
+            #else
+                return _pid >= 0;
+            #endif
+        }
+
+        // spawn argv[0] with argv, searching PATH, returns false on failure;
+        // with errors, stderr goes to the pipe too
+        bool start(char* argv[], bool errors = false) {
+            verify(not *this);
+            _name.clear(); _name << argv[0];
+
+            #if defined(_WIN32)
+
+                using namespace ::cxe::shell::_win32;
+
+                SECURITY_ATTRIBUTES sa {
+                    .nLength        = sizeof(sa),
+                    .bInheritHandle = true,
+                };
+
+                void* rd = nullptr;
+                void* wr = nullptr;
+                if (not CreatePipe(&rd, &wr, &sa, 0)) return false;
+                SetHandleInformation(rd, HANDLE_FLAG_INHERIT, 0);
+
+                STARTUPINFOA si {
+                    .cb         = sizeof(si),
+                    .dwFlags    = STARTF_USESTDHANDLES,
+                    .hStdInput  = GetStdHandle(STD_INPUT_HANDLE),
+                    .hStdOutput = wr,
+                    .hStdError  = errors ? wr : GetStdHandle(STD_ERROR_HANDLE),
+                };
+
+                PROCESS_INFORMATION pi;
+
+                buffer<char> buf;
+                for (auto argp = argv; *argp; ++argp) {
+                    if (buf.size())
+                        buf << " ";
+                    buf << *argp;
+                }
+
+                const int created = CreateProcessA(
+                    nullptr,    // lpApplicationName
+                    buf.data(), // lpCommandLine
+                    nullptr,    // lpProcessAttributes
+                    nullptr,    // lpThreadAttributes
+                    true,       // bInheritHandles
+                    0,          // dwCreationFlags
+                    nullptr,    // lpEnvironment
+                    nullptr,    // lpCurrentDirectory
+                    &si,        // lpStartupInfo
+                    &pi         // lpProcessInformation
+                );
+
+                // only the child may hold the write end, or reads never end
+                CloseHandle(wr);
+
+                if (not created) {
+                    CloseHandle(rd);
+                    return false;
+                }
+
+                CloseHandle(pi.hThread);
+                _process = pi.hProcess;
+                _pipe = rd;
+                return true;
+
+            #else
+
+                using namespace ::cxe::shell::_posix;
+
+                int fds[2];
+                #if defined(__linux__)
+                    if (pipe2(fds, O_CLOEXEC)) return false;
+                #else
+                    if (pipe(fds)) return false;
+                    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+                    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+                #endif
+
+                // dup2() clears close-on-exec on the child's stdout
+                posix_spawn_file_actions_t actions;
+                posix_spawn_file_actions_init(&actions);
+                posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+                if (errors) posix_spawn_file_actions_adddup2(&actions, fds[1], 2);
+
+                _pid = spawn(argv, &actions);
+                posix_spawn_file_actions_destroy(&actions);
+
+                // only the child may hold the write end, or reads never end
+                close(fds[1]);
+
+                if (_pid < 0) {
+                    close(fds[0]);
+                    return false;
+                }
+
+                _pipe = fds[0];
+                return true;
+
+            #endif
+        }
+
+        // Append the child's output to out, with "\r\n" normalized to "\n"
+        // and trailing newlines removed, then wait for the child to exit.
+        // Returns its exit status.
+        int finish(buffer<char>& out) {
+            if (not *this) return -1;
+
+            const size_t start = out.size();
+            size_t size = start;
+
+            #if defined(_WIN32)
+
+                using namespace ::cxe::shell::_win32;
+
+                for (;;) {
+                    out.resize(size + CHUNK);
+                    uint32_t n = 0;
+                    if (not ReadFile(_pipe, out.data() + size, CHUNK, &n, nullptr))
+                        break;
+                    if (n == 0) break;
+                    size += n;
+                }
+                out.resize(size);
+                CloseHandle(_pipe);
+
+                WaitForSingleObject(_process, INFINITE);
+                int status = -1;
+                if (not GetExitCodeProcess(_process, &status)) status = -1;
+                CloseHandle(_process);
+                _process = nullptr;
+                _pipe = nullptr;
+
+            #else
+
+                for (;;) {
+                    out.resize(size + CHUNK);
+                    const ssize_t n = ::read(_pipe, out.data() + size, CHUNK);
+                    if (n < 0 and errno == EINTR) continue;
+                    if (n <= 0) break;
+                    size += size_t(n);
+                }
+                out.resize(size);
+                close(_pipe);
+
+                const int status = _posix::wait(_name.data(), _pid);
+                _pid = -1;
+                _pipe = -1;
+
+            #endif
+
+            // normalize only what the child wrote
+            normalize_newlines(out, start);
+            while (out.size() > start and out.back() == '\n') out.pop_back();
+            return status;
+        }
+    };
+
+    // run argv without a shell, and append its output to out, with its
+    // stderr too if errors
+    int capture_argv(buffer<char>& out, char* argv[], bool errors = false) {
+        child c;
+        if (not c.start(argv, errors)) return -1;
+        return c.finish(out);
+    }
+
     int _run(buffer<char>& out, const char* cmd) {
-        cxe::file f = cxe::file::popen(cmd);
-        if (not f) {
+        #if defined(_WIN32)
+            char* argv[] = {
+                const_cast<char*>("cmd"),
+                const_cast<char*>("/c"),
+                const_cast<char*>(cmd),
+                nullptr
+            };
+        #else
+            char* argv[] = {
+                const_cast<char*>("/bin/sh"),
+                const_cast<char*>("-c"),
+                const_cast<char*>(cmd),
+                nullptr
+            };
+        #endif
+
+        child c;
+        if (not c.start(argv)) {
             using namespace escape_codes;
             print(LTRED,"error: ",RESET,"command not found: \"",cmd,"\"");
             exit(1);
         }
 
-        char buf[16]; while (f.read(buf)) out << buf;
-        normalize_newlines(out);
-        trim_trailing_newlines(out);
-        // println("out: {",out.data(),"}[",strlen(out.data()),"]\n");
-        return f.close();
+        return c.finish(out);
     }
 
     int run(buffer<char>& out, const char* cmd) {
@@ -375,12 +618,102 @@ namespace cxe::shell {
 
     //--------------------------------------------------------------------------
 
-    int which(buffer<char>& out, const char* cmd) {
+    bool _executable(const char* path) {
+        const path::info info = path::stat(path);
+        if (not info or info.dir) return false;
         #if defined(_WIN32)
-            return shell::run(out, "where ", cmd);
+            return true;
         #else
-            return shell::run(out, "which ", cmd);
+            return 0 == access(path, X_OK);
         #endif
     }
 
+    // Resolve cmd the way `which` does, by searching the directories in PATH
+    // for an executable file, without spawning a process.  On Windows, the
+    // current directory is searched first, and extensions in PATHEXT are
+    // tried if cmd has none.
+    int _which(buffer<char>& out, const char* cmd) {
+        verify(cmd);
+        if (not cmd[0]) return 1;
+
+        #if defined(_WIN32)
+            constexpr char separator = ';';
+            const char* const exts = [&]() -> const char* {
+                if (strchr(cmd, '.')) return "";
+                const char* const pathext = getenv("PATHEXT");
+                return pathext ? pathext : ".COM;.EXE;.BAT;.CMD";
+            }();
+        #else
+            constexpr char separator = ':';
+            const char* const exts = "";
+        #endif
+
+        buffer<char> candidate;
+
+        // try cmd, then cmd with each extension, in directory dir
+        auto probe = [&](const char* dir, size_t dir_len) -> bool {
+            const char* ext = exts;
+            for (;;) {
+                const char* const ext_end = strchr(ext, separator);
+                const size_t ext_len = ext_end ? ext_end - ext : strlen(ext);
+                candidate.clear();
+                if (dir) {
+                    candidate << scan::span_t(dir, dir_len);
+                    if (dir_len == 0) candidate << ".";
+                    candidate << "/";
+                }
+                candidate << cmd << scan::span_t(ext, ext_len);
+                if (_executable(candidate.data())) return true;
+                if (not ext_end) return false;
+                ext = ext_end + 1;
+            }
+        };
+
+        bool found = false;
+
+        if (strchr(cmd, '/') or strchr(cmd, '\\')) {
+            // like which, check paths with separators directly
+            found = probe(nullptr, 0);
+        } else {
+            #if defined(_WIN32)
+                found = probe(".", 1);
+            #endif
+            const char* const env_path = getenv("PATH");
+            for (const char* dir = env_path; dir and not found;) {
+                const char* const dir_end = strchr(dir, separator);
+                const size_t dir_len = dir_end ? dir_end - dir : strlen(dir);
+                found = probe(dir, dir_len);
+                dir = dir_end ? dir_end + 1 : nullptr;
+            }
+        }
+
+        if (not found) return 1;
+        path::normalize(candidate);
+        out << candidate.data();
+        return 0;
+    }
+
+    // _which(), memoized for the lifetime of this process
+    int which(buffer<char>& out, const char* cmd) {
+        struct entry {
+            buffer<char> cmd;
+            buffer<char> path;
+            int          status = 0;
+        };
+        static buffer<entry> memo;
+
+        for (const entry& e : memo) {
+            if (0 == strcmp(e.cmd.data(), cmd)) {
+                out << e.path.data();
+                return e.status;
+            }
+        }
+
+        entry& e = memo.emplace_back();
+        e.cmd << cmd;
+        e.status = _which(e.path, cmd);
+        out << e.path.data();
+        return e.status;
+    }
+
 } // namespace cxe::shell
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+#include <string.h>
+#include "verify.hpp"
+#include "async.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "depfile.hpp"
+#include "file.hpp"
+#include "hash.hpp"
+#include "lock.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "scan.hpp"
+
+// Host-wide pool of precompiled standard library headers.
+//
+// With -std-pch, the compile includes a precompiled header of the common
+// standard headers (<vector>, <string>, <unordered_map>, ... or <stdio.h>,
+// <stdlib.h>, ... for C) from the pool in the cache directory:
+//
+//     pch/<key>/std.h        the headers to precompile
+//     pch/<key>/std.h.gch    precompiled by gcc, or std.h.pch by clang
+//     pch/<key>/lock         held while building
+//     pch/<key>/std.h.gch.inputs
+//                            size, modification time and path of each file
+//                            the precompiled header was built from
+//
+// <key> hashes the compiler identity, the language and the arguments which
+// must match between a precompiled header and its users: -std=, -D/-U, and
+// the -f, -m, -O, -g and target options.  Other arguments, such as -I and
+// -W, do not take part, so every project on the host built with the same
+// key shares one precompiled header.  The first build of a key takes the
+// lock, so concurrent cxe processes wait for it rather than build it again.
+// The key does not cover the system headers, so a precompiled header whose
+// inputs have changed since, e.g. by an update of libc, is built again.
+
+namespace cxe::stdpch {
+
+    static constexpr const char CPP_HEADERS[] =
+        "#include <algorithm>\n"
+        "#include <array>\n"
+        "#include <cstdint>\n"
+        "#include <cstdio>\n"
+        "#include <cstdlib>\n"
+        "#include <cstring>\n"
+        "#include <functional>\n"
+        "#include <map>\n"
+        "#include <memory>\n"
+        "#include <set>\n"
+        "#include <string>\n"
+        "#include <unordered_map>\n"
+        "#include <unordered_set>\n"
+        "#include <utility>\n"
+        "#include <vector>\n"
+        "#if __cplusplus >= 201703L\n"
+        "#include <optional>\n"
+        "#include <string_view>\n"
+        "#include <variant>\n"
+        "#endif\n"
+        "#if __cplusplus >= 202002L\n"
+        "#include <span>\n"
+        "#endif\n";
+
+    static constexpr const char C_HEADERS[] =
+        "#include <assert.h>\n"
+        "#include <ctype.h>\n"
+        "#include <errno.h>\n"
+        "#include <limits.h>\n"
+        "#include <math.h>\n"
+        "#include <stdarg.h>\n"
+        "#include <stddef.h>\n"
+        "#include <stdint.h>\n"
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "#include <string.h>\n";
+
+    // options whose value is the next argument
+    bool takes_value(const token_t& t) {
+        using namespace ::cxe::scan;
+        return equals("-D", t) or equals("-U", t) or equals("-target", t)
+            or equals("-isysroot", t) or equals("--sysroot", t);
+    }
+
+    // arguments which must match between a precompiled header and its users
+    bool is_abi_arg(const token_t& t) {
+        using namespace ::cxe::scan;
+        return prefix("-std=", t) or prefix("-D", t) or prefix("-U", t)
+            or prefix("-f", t) or prefix("-m", t) or prefix("-O", t)
+            or prefix("-g", t) or equals("-pthread", t)
+            or prefix("--target=", t) or equals("-target", t)
+            or prefix("-stdlib=", t) or prefix("-nostdinc", t)
+            or prefix("-isysroot", t) or prefix("--sysroot", t);
+    }
+
+    // directory of the pool
+    buffer<char> pool_dir() {
+        buffer<char> buf; print_to(buf, cache::dir(), "/pch");
+        return buf;
+    }
+
+    // whether cmd builds a precompiled header of the pool
+    bool pooled(const command& cmd) {
+        const buffer<char> dir = pool_dir();
+        return 0 == strncmp(cmd.output(), dir.data(), dir.size());
+    }
+
+    // The paths prepare() derives from the output of a pool build: the
+    // header it precompiles, and the temporary output it is built to, so
+    // that users of the pool never observe a partial precompiled header.
+    buffer<char> header_path(const char* output) {
+        buffer<char> header; header << output;
+        header.resize(strlen(output) - strlen(".gch"));
+        return header;
+    }
+
+    buffer<char> temp_path(const char* output) {
+        buffer<char> temp; temp << output << ".tmp";
+        return temp;
+    }
+
+    buffer<char> inputs_path(const char* output) {
+        buffer<char> inputs; inputs << output << ".inputs";
+        return inputs;
+    }
+
+    buffer<char> depfile_path(const char* output) {
+        buffer<char> dep; dep << output << ".d";
+        return dep;
+    }
+
+    // Record the inputs of output, listed by its depfile, see above.
+    bool record(const char* output) {
+        const buffer<char> dep_path = depfile_path(output);
+        buffer<char> deps;
+        const bool loaded = file::load(dep_path.data(), deps);
+        path::remove(dep_path.data());
+        if (not loaded) return false;
+
+        buffer<char> text;
+        depfile::parse(deps, [&](const buffer<char>& p) {
+            const path::info info = path::stat(p.data());
+            println_to(text, info.size, " ", info.mtime, " ", p.data());
+        });
+        const buffer<char> inputs = inputs_path(output);
+        return file::save(inputs.data(), text.data(), text.size());
+    }
+
+    // whether output exists, and its inputs are as recorded
+    bool current(const char* output) {
+        if (not path::exists(output)) return false;
+        buffer<char> text;
+        if (not file::load(inputs_path(output).data(), text)) return false;
+
+        char* itr = text.data();
+        char* const end = itr + text.size();
+        while (itr < end) {
+            char* eol = (char*)memchr(itr, '\n', size_t(end - itr));
+            if (not eol) eol = end;
+            *eol = 0;
+            char* p = itr;
+            const uint64_t size = strtoull(p, &p, 10);
+            const int64_t mtime = strtoll(p, &p, 10);
+            if (*p++ != ' ') return false;
+            const path::info info = path::stat(p);
+            if (not info or info.size != size or info.mtime != mtime) return false;
+            itr = eol + 1;
+        }
+        return true;
+    }
+
+    // Set up dst to precompile the pool header for the compile src, with
+    // the compiler and ABI arguments of src.  Returns the path of the pool
+    // header, which dst builds as <header>.gch with gcc or <header>.pch with
+    // clang.  The header itself is written by build().
+    buffer<char> prepare(const context& ctx, command& dst, command& src, bool cpp) {
+        char** const argv = src.argv();
+        const size_t argc = src.argc();
+
+        dst.append(token_t(argv[0], strlen(argv[0])));
+        for (size_t i = 1; i < argc; ++i) {
+            const token_t t { argv[i], strlen(argv[i]) };
+            const size_t n = takes_value(t) and i + 1 < argc ? 2 : 1;
+            if (is_abi_arg(t)) {
+                for (size_t k = i; k < i + n; ++k)
+                    dst.append(token_t(argv[k], strlen(argv[k])));
+            }
+            i += n - 1;
+        }
+        dst.append(token_t("-x"));
+        if (cpp) dst.append(token_t("c++-header"));
+        else     dst.append(token_t("c-header"));
+
+        cxe::hash h;
+        h.update("cxe/stdpch/1");
+        cache::hash_compiler(h, ctx);
+        for (const char* arg : dst) h.update(arg);
+        char key[17]; hash::format(key, h.digest());
+
+        buffer<char> output; print_to(output, pool_dir().data(), "/", key, "/std.h");
+        output << (ctx.compiler_is_clang ? ".pch" : ".gch");
+        buffer<char> header = header_path(output.data());
+
+        // with system headers, unlike -MMD, as those are what may change
+        dst.append(token_t("-MD", 3));
+        dst.append(token_t("-MF", 3));
+        dst.append(depfile_path(output.data()));
+        dst.append(header);
+        dst.append(token_t("-o"));
+        dst.append(temp_path(output.data()));
+        dst.output(output);
+        return header;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Build the pool header of cmd, set up by prepare(), unless a current
+    // build of it exists, waiting for any concurrent build of it to finish.
+    async::task build(command& cmd, async::loop& loop, const char* echo) {
+        const char* const output = cmd.output();
+        if (current(output)) co_return 0;
+
+        // by value, not position, as the compile may have gained arguments
+        const buffer<char> header = header_path(output);
+        const buffer<char> temp   = temp_path(output);
+        const bool cpp = cmd.find(scan::equals, token_t("c++-header", 10));
+
+        buffer<char> dir; dir << header.data();
+        dir.resize(header.size() - strlen("/std.h"));
+        if (not path::make_dirs(dir.data())) co_return 1;
+
+        // another process may be building it; poll for the lock through
+        // the loop, so that the other jobs go on meanwhile
+        buffer<char> lock_path; lock_path << dir.data() << "/lock";
+        lock l { lock_path.data(), false };
+        while (l.waiting()) {
+            co_await loop.sleep(50);
+            l.retry();
+        }
+
+        // built by another process while we waited
+        if (current(output)) co_return 0;
+
+        const char* const text = cpp ? CPP_HEADERS : C_HEADERS;
+        if (not file::save(header.data(), text, strlen(text))) co_return 1;
+
+        const int status = co_await loop.spawn(cmd.argv(), { .echo = echo });
+        if (status) {
+            path::remove(temp.data());
+            co_return status;
+        }
+        if (not path::rename(temp.data(), output)) co_return 1;
+        // without a record, the next build makes it again
+        record(output);
+        co_return 0;
+    }
+
+} // namespace cxe::stdpch
@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "scan.hpp"
+
+// ThinLTO cache of a multi-source build.
+//
+// With -flto=thin, every link runs the LTO backend, optimization and code
+// generation, on every module again, unless the linker has a cache of the
+// backend results.  The link of a clang multi-source build (see
+// parser::fan_out()) with -flto=thin therefore gets a cache directory in the
+// object store, <store>/thinlto, along with a pruning policy and the number
+// of backend jobs:
+//
+//   - lld:                --thinlto-cache-dir=, --thinlto-cache-policy=,
+//                         --thinlto-jobs=
+//   - gold, mold and bfd: -plugin-opt cache-dir=, cache-policy=, jobs=
+//   - ld64:               -cache_path_lto, -prune_after_lto
+//   - lld-link:           /lldltocache:, /lldltocachepolicy:, /opt:lldltojobs=
+//
+// Entries unused for CXE_THINLTO_PRUNE_AFTER (default 168h) are pruned, as
+// are the least recently used once the cache exceeds CXE_THINLTO_CACHE_SIZE
+// (default 1G).  After each link, cxe reports how many modules the backend
+// reused, that is, the modules linked less the entries the link added.
+
+namespace cxe::thinlto {
+
+    // whether cmd links with ThinLTO
+    bool enabled(const command& cmd) {
+        return cmd.find(scan::equals, token_t("-flto=thin", 10));
+    }
+
+    // CXE_THINLTO_PRUNE_AFTER in seconds, given as e.g. "90m", "72h" or "7d"
+    uint64_t prune_after() {
+        uint64_t seconds = 168 * 60 * 60;
+        if (const char* const value = getenv("CXE_THINLTO_PRUNE_AFTER")) {
+            char* end = nullptr;
+            uint64_t n = strtoull(value, &end, 10);
+            switch (end ? *end : 0) {
+                case 'm': n *= 60; break;
+                case 'h': n *= 60 * 60; break;
+                case 'd': n *= 24 * 60 * 60; break;
+            }
+            if (end != value) seconds = n;
+        }
+        return seconds;
+    }
+
+    // CXE_THINLTO_CACHE_SIZE, e.g. "512M" or "2G"
+    uint64_t max_size() {
+        return cache::parse_size(getenv("CXE_THINLTO_CACHE_SIZE"), uint64_t(1) << 30);
+    }
+
+    // Append the cache directory <store>/thinlto, pruning policy and backend
+    // jobs to the link cmd, spelled for its linker.
+    void append_args(command& cmd, const buffer<char>& store, size_t jobs) {
+        using namespace ::cxe::scan;
+        buffer<char> dir; dir << store.data() << "/thinlto";
+
+        buffer<char> policy;
+        print_to(policy, "prune_after=", prune_after(), "s:cache_size_bytes=", max_size());
+
+        buffer<char> arg;
+        auto append = [&](const auto&... parts) {
+            arg.clear();
+            print_to(arg, parts...);
+            cmd.append(arg);
+        };
+
+        #if defined(_WIN32)
+            append("-Wl,/lldltocache:", dir.data());
+            append("-Wl,/lldltocachepolicy:", policy.data());
+            append("-Wl,/opt:lldltojobs=", jobs);
+        #elif defined(__APPLE__)
+            append("-Wl,-cache_path_lto,", dir.data());
+            append("-Wl,-prune_after_lto,", prune_after());
+        #else
+            const char* const lld = cmd.find(equals, token_t("-fuse-ld=lld", 12));
+            const char* const ld_path = cmd.find(prefix, token_t("--ld-path=", 10));
+            if (lld or (ld_path and strstr(ld_path, "lld"))) {
+                append("-Wl,--thinlto-cache-dir=", dir.data());
+                append("-Wl,--thinlto-cache-policy=", policy.data());
+                append("-Wl,--thinlto-jobs=", jobs);
+            } else {
+                append("-Wl,-plugin-opt,cache-dir=", dir.data());
+                append("-Wl,-plugin-opt,cache-policy=", policy.data());
+                append("-Wl,-plugin-opt,jobs=", jobs);
+            }
+        #endif
+    }
+
+    //--------------------------------------------------------------------------
+
+    // the cache directory set by append_args(), or an empty buffer
+    buffer<char> cache_dir(command& cmd) {
+        static const char* const markers[] = {
+            "cache-dir=", "/lldltocache:", "-cache_path_lto,",
+        };
+        buffer<char> dir;
+        for (const char* arg : cmd) {
+            for (const char* marker : markers) {
+                const char* const at = strstr(arg, marker);
+                if (not at) continue;
+                dir << (at + strlen(marker));
+                return dir;
+            }
+        }
+        return dir;
+    }
+
+    // The entries of the cache of a link, taken before it runs, against
+    // which report() tells the entries added by the link.
+    class snapshot {
+        buffer<char>         _dir;
+        buffer<buffer<char>> _names;
+        size_t               _modules = 0;
+
+        template<typename Fn>
+        void each_entry(Fn&& fn) const {
+            path::each(_dir.data(), [&](const char* name) {
+                // e.g. the llvmcache.timestamp of the last pruning
+                if (scan::suffix(".timestamp", token_t(name, strlen(name)))) return;
+                fn(name);
+            });
+        }
+
+    public:
+
+        explicit snapshot(command& cmd) : _dir(cache_dir(cmd)) {
+            if (_dir.empty()) return;
+
+            // the objects of the build, which the store holds beside the cache
+            const size_t store_size = _dir.size() - strlen("/thinlto");
+            for (const char* arg : cmd) {
+                const token_t t { arg, strlen(arg) };
+                if (strncmp(arg, _dir.data(), store_size)) continue;
+                if (scan::suffix(".o", t) or scan::suffix(".obj", t)) ++_modules;
+            }
+
+            each_entry([&](const char* name) { _names.emplace_back() << name; });
+        }
+
+        // print how many modules the link reused from the cache
+        void report() const {
+            if (not _modules) return;
+
+            size_t added = 0;
+            each_entry([&](const char* name) {
+                for (const buffer<char>& old : _names)
+                    if (0 == strcmp(old.data(), name)) return;
+                ++added;
+            });
+
+            const size_t reused = added < _modules ? _modules - added : 0;
+            println("thinlto: ", reused, " of ", _modules, " modules reused");
+        }
+    };
+
+} // namespace cxe::thinlto
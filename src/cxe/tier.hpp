@@ -0,0 +1,135 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "deps.hpp"
+#include "file.hpp"
+#include "path.hpp"
+#include "print.hpp"
+#include "scan.hpp"
+
+#if not defined(_WIN32)
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <unistd.h>
+#endif
+
+// Tiered builds, with -tiered.
+//
+// "cxe <source> -tiered -- <args>" runs the build as usual once it is
+// current.  Until then, rather than wait for it, cxe builds a fast tier of
+// the program, at -O0 and without LTO, PGO, post-link optimization or
+// -march-variants=, to <output dir>/.cxe/<source name>-tier/<output name>,
+// and runs that, while a detached cxe makes the build current in the
+// background.  The state of the background build is kept beside the fast
+// tier:
+//
+//     background.pid    the process id of the background build, while it runs
+//     background.log    its output
+//
+// The build is current when no background build is running and none of the
+// compiles, precompiled headers and links of the build needs to run.
+
+namespace cxe::tier {
+
+    // whether the background build of dir is running
+    bool building(const buffer<char>& dir) {
+        #if defined(_WIN32)
+            (void)dir;
+            return false;
+        #else
+            buffer<char> pid_path; pid_path << dir.data() << "/background.pid";
+            buffer<char> text;
+            if (not file::load(pid_path.data(), text) or text.empty()) return false;
+            const long pid = strtol(text.data(), nullptr, 10);
+            return pid > 0 and 0 == kill(pid_t(pid), 0);
+        #endif
+    }
+
+    // whether the build of cmds is current, see above
+    bool ready(const buffer<char>& dir, buffer<command>& cmds) {
+        if (building(dir)) return false;
+        for (command& cmd : cmds) {
+            const command::kind_t kind = cmd.kind();
+            if (kind != command::pch and kind != command::compile and kind != command::link)
+                continue;
+            if (not deps::up_to_date(cmd)) return false;
+        }
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // the fast tier of the program named out_name, in dir
+    buffer<char> fast_path(const buffer<char>& dir, const token_t& out_name) {
+        buffer<char> path; path << dir.data() << "/" << out_name;
+        return path;
+    }
+
+    // append the arguments which make the compile cmd that of the fast tier
+    void append_fast_args(command& cmd) {
+        using namespace ::cxe::scan;
+        cmd.append(token_t("-O0", 3));
+        if (cmd.find(prefix, token_t("-flto", 5)))
+            cmd.append(token_t("-fno-lto", 8));
+    }
+
+    // make cmd, which holds the arguments of this cxe, the background build
+    void append_background_args(command& cmd) {
+        cmd.name(token_t("tier-background", 15));
+        cmd.append(token_t("--tier-background", 17));
+    }
+
+    //--------------------------------------------------------------------------
+
+    #if not defined(_WIN32)
+
+        // the pid file of this process, removed as it exits
+        buffer<char>& pid_path() {
+            static buffer<char> path;
+            return path;
+        }
+
+        void remove_pid_path() {
+            buffer<char> text;
+            if (not file::load(pid_path().data(), text)) return;
+            if (strtol(text.data(), nullptr, 10) == long(getpid()))
+                path::remove(pid_path().data());
+        }
+
+    #endif
+
+    // Continue this process as the background build of dir: the parent
+    // records the pid of the child and exits, while the child leaves the
+    // session of the terminal and logs to dir.  On Windows, the build runs
+    // in the foreground.
+    void detach(const buffer<char>& dir) {
+        #if not defined(_WIN32)
+            pid_path() << dir.data() << "/background.pid";
+            buffer<char> log_path; log_path << dir.data() << "/background.log";
+
+            fflush(stdout);
+            fflush(stderr);
+            const pid_t pid = fork();
+            if (pid < 0) return;
+            if (pid > 0) {
+                buffer<char> text; println_to(text, long(pid));
+                file::save(pid_path().data(), text.data(), text.size());
+                _exit(0);
+            }
+
+            setsid();
+            const int null = open("/dev/null", O_RDONLY);
+            if (null >= 0) { dup2(null, 0); close(null); }
+            const int log = open(log_path.data(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+            if (log >= 0) { dup2(log, 1); dup2(log, 2); close(log); }
+            atexit(remove_pid_path);
+        #else
+            (void)dir;
+        #endif
+    }
+
+} // namespace cxe::tier
@@ -0,0 +1,193 @@
+#pragma once
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "verify.hpp"
+#include "buffer.hpp"
+#include "command.hpp"
+#include "context.hpp"
+#include "file.hpp"
+#include "jobserver.hpp"
+#include "print.hpp"
+#include "probe.hpp"
+#include "schedule.hpp"
+#include "shell.hpp"
+
+// Search of compilers and flags for the fastest program, with --tune.
+//
+// The cxe block declares the search space: the compilers of
+// -tune-compilers { <name or path>... }, found on PATH like the default
+// compiler, or else the default compiler alone, and the flag sets of each
+// -tune { <flags> }, appended to the flags of the build.  "cxe <source>
+// --tune" then builds every compiler and flag set as a variant, each by a
+// nested cxe into <output dir>/.cxe/<source name>-tune/<n>/, concurrently,
+// and times the variants running with the arguments after --:
+//
+//   - one untimed run of each variant first, to warm caches
+//   - CXE_TUNE_TRIALS (default 10) timed runs of each, taking turns, so
+//     that drift of the host, e.g. of its clock speed, spreads evenly
+//
+// Variants are reported by mean time with a 95% confidence interval, and the
+// fastest is marked as such only if its interval is clear of the runner-up.
+// With -tuned <file> in the block, the flags of the fastest are written to
+// <file>, which later builds append to their flags.
+
+namespace cxe::tune {
+
+    // CXE_TUNE_TRIALS, at least two for an interval
+    size_t trials() {
+        if (const char* const value = getenv("CXE_TUNE_TRIALS")) {
+            char* end = nullptr;
+            const size_t n = strtoull(value, &end, 10);
+            if (end != value) return n < 2 ? 2 : n;
+        }
+        return 10;
+    }
+
+    struct variant {
+        buffer<char> label;    // compiler name and flags, for the report
+        buffer<char> compiler; // path of the compiler
+        buffer<char> flags;    // the flag set, separated by spaces
+        command      run;      // the program, with the arguments after --
+    };
+
+    struct plan {
+        buffer<command> builds;   // one nested cxe per variant
+        buffer<variant> variants;
+        buffer<char>    tuned;    // -tuned <file>, or empty
+    };
+
+    // Find the compiler name, as main() finds the default compiler.
+    // Returns non-zero if it is not found.
+    int find_compiler(buffer<char>& out, token_t name) {
+        if (scan::contains("/", name)) {
+            out << name;
+            return 0;
+        }
+        buffer<char> buf; buf << name;
+        return probe::which(out, buf.data());
+    }
+
+    //--------------------------------------------------------------------------
+
+    // two-sided 95% quantile of Student's t distribution with df degrees of
+    // freedom
+    double t95(size_t df) {
+        static constexpr double TABLE[] = {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+             2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+             2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+        };
+        constexpr size_t SIZE = sizeof(TABLE) / sizeof(*TABLE);
+        verify(df > 0);
+        return df <= SIZE ? TABLE[df - 1] : 1.960;
+    }
+
+    struct result {
+        size_t index  = 0;
+        double mean   = 0; // ms
+        double margin = 0; // half width of the 95% interval, ms
+        int    status = 0; // of the first failed run
+    };
+
+    // Run the program of v, in milliseconds, with its stdout and stderr
+    // captured to output, to be shown only if it fails.
+    double time_run(variant& v, int& status, buffer<char>& output) {
+        using clock = std::chrono::steady_clock;
+        output.clear();
+        const auto start = clock::now();
+        status = shell::capture_argv(output, v.run.argv(), true);
+        const std::chrono::duration<double, std::milli> took = clock::now() - start;
+        return took.count();
+    }
+
+    // Write the flags of the fastest variant to file.
+    void write(const char* file, const variant& v, const result& r, size_t n) {
+        char stats[64];
+        snprintf(stats, sizeof(stats), "%.1f ms +/- %.1f", r.mean, r.margin);
+        buffer<char> text;
+        println_to(text, "# written by cxe --tune: ", stats, " (95%) over ", n, " runs");
+        println_to(text, "# compiler: ", v.compiler.data());
+        println_to(text, v.flags.data());
+        if (not file::save(file, text.data(), text.size()))
+            error(1,{},"--tune: failed to write ",file);
+        println("tune: wrote ", file);
+    }
+
+    // Build the variants of p, time them, and report the fastest.
+    int run(const context& ctx, plan& p, size_t jobs, jobserver::client& js) {
+        if (p.variants.empty())
+            error(1,{},"--tune: no -tune { <flags> } in the cxe block");
+
+        println("tune: building ", p.variants.size(), " variants");
+        if (const int status = schedule::run(ctx, p.builds, jobs, js)) return status;
+
+        const size_t n = trials();
+        buffer<buffer<double>> times;
+        buffer<result> results;
+        for (size_t i = 0; i < p.variants.size(); ++i) {
+            times.emplace_back();
+            results.emplace_back().index = i;
+        }
+
+        println("tune: timing ", p.variants.size(), " variants, ", n, " runs each");
+        buffer<char> output;
+        for (size_t trial = 0; trial <= n; ++trial) {
+            for (size_t i = 0; i < p.variants.size(); ++i) {
+                if (results[i].status) continue;
+                int status = 0;
+                const double ms = time_run(p.variants[i], status, output);
+                if (trial and not status) times[i].push_back(ms);
+                if (not status) continue;
+                results[i].status = status;
+                println("tune: ", p.variants[i].label.data(), " failed (", status, "):");
+                if (output.size()) println(output.data());
+            }
+        }
+
+        for (result& r : results) {
+            const buffer<double>& t = times[r.index];
+            if (r.status) continue;
+            double sum = 0;
+            for (double ms : t) sum += ms;
+            r.mean = sum / t.size();
+            double squares = 0;
+            for (double ms : t) squares += (ms - r.mean) * (ms - r.mean);
+            const double sd = sqrt(squares / (t.size() - 1));
+            r.margin = t95(t.size() - 1) * sd / sqrt(double(t.size()));
+        }
+
+        // fastest first, failures last
+        std::stable_sort(results.begin(), results.end(), [](const result& a, const result& b) {
+            if (a.status or b.status) return not a.status and b.status;
+            return a.mean < b.mean;
+        });
+
+        for (const result& r : results) {
+            const variant& v = p.variants[r.index];
+            char text[64];
+            if (r.status) snprintf(text, sizeof(text), "failed (%d)", r.status);
+            else snprintf(text, sizeof(text), "%9.1f ms +/- %.1f", r.mean, r.margin);
+            println(text, "  ", v.label.data());
+        }
+
+        const result& best = results[0];
+        if (best.status) return best.status;
+        const variant& winner = p.variants[best.index];
+
+        if (results.size() > 1 and not results[1].status and
+            best.mean + best.margin >= results[1].mean - results[1].margin) {
+            println("fastest: ", winner.label.data(), ", within the 95% interval of ",
+                p.variants[results[1].index].label.data());
+        } else {
+            println("fastest: ", winner.label.data());
+        }
+
+        if (p.tuned.size()) write(p.tuned.data(), winner, best, n);
+        return 0;
+    }
+
+} // namespace cxe::tune
@@ -64,17 +64,184 @@ OPTIONS:
                 cxe will invoke the compiler's "-print-effective-triple" option
                 to determine the default compilation target.
 
--pre {...}      Run a shell command before compiling.
+-pre [name] [after(name...)] {...}
+                Run a shell command before compiling.
                 If a pre-compile shell command fails, cxe will abort further
                 compilation and return the same exit code that was returned
                 by the failed command.
                 An environment variable CXE=<path to this cxe executable> is
                 defined when running such commands, so that you can easily
                 run the same cxe executable on other dependencies.
--post {...}     Run a shell command after compiling successfully.
+                Pre-compile commands run concurrently, unless ordered with
+                after(...).  A command is named for the stem of its first
+                C/C++ source, unless it is given an explicit name.
+
+                Example: Build two libraries concurrently, then run a code
+                generator that links with both.
+
+                    -pre { $CXE ../lib/a.c }
+                    -pre { $CXE ../lib/b.c }
+                    -pre gen after(a b) { $CXE ../tools/gen.c -- out.h }
+
+-post [name] [after(name...)] {...}
+                Run a shell command after compiling successfully.
                 An environment variable CXE=<path to this cxe executable> is
                 defined when running such commands, so that you can easily
                 run the same cxe executable on other dependencies.
+                Post-compile commands run concurrently, like -pre commands.
+-j <jobs>       Run at most <jobs> commands at once.  The default is the
+                number of CPUs available, honoring the cgroup CPU quota.
+                The output of each command is printed when it finishes.
+                The top-level cxe runs a GNU make compatible jobserver with
+                <jobs> slots, advertised in MAKEFLAGS, which nested cxe, make
+                and ninja processes share.  Under make, cxe joins make's
+                jobserver instead.
+-pch            Precompile the leading block of #include lines of <file>,
+                after the cxe comment, with the flags of the compile, and
+                include it ahead of <file>.  The header is rebuilt when the
+                include block, or any header it includes, changes.
+                Requires clang or gcc.
+-std-pch        Include a precompiled header of common standard headers,
+                e.g. <vector>, <string> and <unordered_map>, from a pool in
+                the cache directory shared by every cxe on the host.  The
+                pool holds one per compiler, language, -std= and set of
+                ABI-affecting options (-D, -U, -f, -m, -O, -g, target), and
+                builds new ones on first use, under a file lock.
+                Ignored with -pch.  Requires clang or gcc.
+-debug          Debug build profile: adds -g, so that -if (-g) holds, and with
+                clang or gcc on Linux, -gsplit-dwarf, -ggnu-pubnames, -gz,
+                and -Wl,--gdb-index when linking with gold, lld or mold.
+                The .dwo files are kept beside the objects (see MULTIPLE
+                SOURCES), even of a single source, and those of removed
+                sources are deleted.
+-dwp            With -debug, pack the .dwo files into <output>.dwp after
+                the link, with dwp (gcc, which then builds DWARF 4) or
+                llvm-dwp (clang).  Without it, a stale .dwp is deleted.
+-dev-shared     Build archive dependencies (-c -o lib<name>.a), here and in
+                nested cxe processes, as shared libraries lib<name>.so
+                (.dylib on macOS) with -fPIC, and link programs with an
+                rpath to their -L directories, so that relinks stay small
+                while iterating.  Without it, such a build removes the
+                shared library beside the archive.  Ignored on Windows.
+-pgo            Compile with an instrumentation profile of the program,
+                made first when missing or out of date: build with
+                -fprofile-instr-generate, train, merge with llvm-profdata.
+                The profile is remade once the sources drift from it by
+                more than CXE_PGO_DRIFT percent (default 10).  Requires
+                clang.
+-train { <args> }
+                With -pgo or -post-link-opt, train with <args>.  May be
+                repeated.  Without it, the program trains with the
+                arguments after --.
+-post-link-opt  Optimize the code layout of the linked program.  With
+                llvm-bolt, link with --emit-relocs, instrument, train and
+                lay out the program, caching the result by the linked
+                program.  Otherwise, with -pgo and lld or mold, link with a
+                --symbol-ordering-file of the hottest functions first.
+-march-variants=<level>,...
+                Build the program once per -march level, concurrently, to
+                <output>.<level>, and make the output a launcher which runs
+                the variant of the last level the CPU supports, e.g.
+                -march-variants=x86-64-v2,x86-64-v3,x86-64-v4.  Requires
+                clang or gcc.
+-tiered         With --, while the build is not current, build a fast tier
+                (-O0, without LTO, -pgo, -post-link-opt or -march-variants=)
+                beside the output and run it, while a detached cxe makes the
+                build current in the background, logging to
+                .cxe/<source name>-tier/background.log.  Later runs use the
+                build once it is current.
+-tune { <flags> }
+                A flag set for --tune to try, appended to the other flags.
+                May be repeated; -tune { } tries the flags as they are.
+-tune-compilers { <compiler>... }
+                The compilers for --tune to try each flag set with, by name
+                on PATH or by path.  Defaults to the compiler of the build.
+-tuned <file>   Append the flags in <file>, written by --tune, if it exists.
+-unity         Compile the sources in batches: each batch is a generated
+                source which #includes its members, and the batches, up to
+                one per job, are balanced by line count and compiled
+                concurrently.  A batch source is only rewritten when its
+                members change.  Module units are never batched.
+-unity-exclude <file>
+                Compile <file>, one of the sources, on its own, e.g. when
+                its static symbols clash with those of other sources.
 --              If the compiled artifact is executable, execute it and
                 pass any subsequent options to the executable.
+--cache-stats   Print the location, size and hit/miss counters of the
+                compile cache, then exit.
+--link-bench    Build, then time the link with each linker the compiler can
+                use (see LINKER), and record the fastest for later builds.
+--tune          Build each compiler and -tune flag set concurrently, time
+                each program CXE_TUNE_TRIALS times (default 10) with the
+                arguments after --, report the mean times with their 95%
+                confidence intervals, and write the fastest flags to the
+                -tuned <file>, if any.
+
+MULTIPLE SOURCES:
+When compiling several C/C++ sources with clang or gcc, without -c, -S, -E
+or -x, cxe compiles each source to an object of its own, concurrently, in
+.cxe/<source name>-<flags hash>/ beside the output, then links the objects:
+
+    cxe main.c util.c -lm -o bin/tool
+
+    cc -c util.c -o bin/.cxe/main-1f2e3d4c/util.o ...
+    cc -c main.c -o bin/.cxe/main-1f2e3d4c/main.o ...
+    cc bin/.cxe/main-1f2e3d4c/util.o -lm -o bin/tool bin/.cxe/main-...
+
+Compile options (-D, -U, -I, -include, -std=, -W...) are left out of the
+link, and link options (-l, -L, -Wl,, -framework, libraries) out of the
+compiles.  Only objects whose inputs changed are rebuilt, and the link is
+skipped if no object was.  Each set of compile flags keeps its own objects.
+
+C++20 named modules among the sources (export module, module, import) are
+built in dependency order: the compile of each module interface writes its
+BMI to the same directory as the objects, before the compiles which import
+it start.  clang gets -fmodule-output= and -fprebuilt-module-path=, gcc gets
+-fmodules-ts and a -fmodule-mapper= file.  Sources may also be named .cppm
+or .ixx.  Imports of std and std.compat are built from the sources named by
+the module manifest of the standard library, even for a single source.
+Header units are left to the compiler.
+
+LINKER:
+Unless -fuse-ld= or --ld-path= is given, links with clang or gcc on Linux
+get -fuse-ld= for the first of mold, lld and gold that the compiler can run,
+probed once per compiler and PATH.  The winner of --link-bench, if any,
+takes precedence.
+
+THINLTO:
+The link of a clang multi-source build with -flto=thin gets a ThinLTO cache
+in the object store, so that unchanged modules skip the LTO backend, and
+one backend job per -j.  Each link reports how many modules it reused.
+
+    CXE_THINLTO_CACHE_SIZE=...   Maximum cache size, default: 1G
+    CXE_THINLTO_PRUNE_AFTER=...  Prune entries unused for e.g. 90m, 72h or
+                                 7d, default: 168h
+
+UP-TO-DATE CHECK:
+When compiling with clang or gcc to an explicit -o <path>, cxe adds
+"-MMD -MF <path>.d" to the compile command, and records a signature of the
+final command line and the list of inputs in <path>.cxedeps.  The compile is
+skipped while the signature matches and no input is newer than <path>.
+
+CACHE:
+When compiling with clang or gcc to an explicit -o <path>, cxe keeps the
+artifact and diagnostics of each compile in a local cache, keyed on the
+compiler, the resolved command line and the contents of every input listed
+in the compiler's dependency output.  On a cache hit the artifact is restored
+and the diagnostics are replayed without running the compiler.
+
+    CXE_CACHE=0         Disable the compile cache.
+    CXE_CACHE_DIR=...   Cache location, default: ~/.cache/cxe
+    CXE_CACHE_SIZE=...  Maximum cache size, e.g. 512M, 4G, default: 1G
+                        Least recently used artifacts are evicted first.
+
+Toolchain probes, such as the compiler's "-print-effective-triple" and the
+PATH lookup of the default compiler, are also kept in the cache directory,
+and are passed on to nested "$CXE ..." invocations as CXE_PROBE_* variables.
+
+With clang, the job which the driver runs for a compile with -c, or a link
+of objects, is found once per command line with -###, kept in the cache
+directory, and then run directly, without the driver.
+
+    CXE_CC1=0           Always run the clang driver.
 )";